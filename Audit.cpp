@@ -0,0 +1,244 @@
+#include "Audit.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+/*
+ * Replacement of global allocation for PENDULUM_AUDIT builds.
+ * Nothing here may allocate while counting: sites live in a fixed table
+ * and are found by name, counters are relaxed atomics.
+ */
+namespace
+{
+	struct Counters
+	{
+		std::atomic<std::size_t> allocations = 0, bytes = 0, copies = 0, copiedBytes = 0;
+
+		void Clear() noexcept
+		{
+			allocations = 0;
+			bytes = 0;
+			copies = 0;
+			copiedBytes = 0;
+		}
+		audit::Counts Load() const noexcept { return {allocations.load(), bytes.load(), copies.load(), copiedBytes.load()}; }
+	};
+
+	struct SiteSlot
+	{
+		std::atomic<char const*> name = nullptr;
+		Counters total, update, peak;
+	};
+
+	constexpr std::size_t maxSites = 256;
+	SiteSlot sites[maxSites];
+	Counters totals;
+	std::atomic<std::size_t> updates = 0, frees = 0, violations = 0;
+
+	char const* const unscoped = "(unscoped)";
+	char const* const overflow = "(too many sites)";
+	thread_local char const* current = nullptr;
+	// noAlloc scopes entered and not left, named scopes inside them are forbidden too
+	thread_local int forbidden = 0;
+	// set while the audit itself allocates (reports, snapshots)
+	thread_local bool busy = false;
+
+	SiteSlot& Find(char const* name) noexcept
+	{
+		for (std::size_t i = 0; i < maxSites - 1; i++)
+		{
+			auto n = sites[i].name.load(std::memory_order_acquire);
+			if (n == nullptr)
+			{
+				if (sites[i].name.compare_exchange_strong(n, name, std::memory_order_acq_rel))
+					return sites[i];
+			}
+			// same literal may have different addresses in different translation units
+			if (n == name || std::strcmp(n, name) == 0)
+				return sites[i];
+		}
+		sites[maxSites - 1].name = overflow;
+		return sites[maxSites - 1];
+	}
+
+	void Add(Counters& c, std::size_t allocations, std::size_t bytes, std::size_t copies, std::size_t copiedBytes) noexcept
+	{
+		c.allocations.fetch_add(allocations, std::memory_order_relaxed);
+		c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+		c.copies.fetch_add(copies, std::memory_order_relaxed);
+		c.copiedBytes.fetch_add(copiedBytes, std::memory_order_relaxed);
+	}
+
+	void Charge(std::size_t allocations, std::size_t bytes, std::size_t copies, std::size_t copiedBytes) noexcept
+	{
+		if (busy)
+			return;
+		auto name = current ? current : unscoped;
+		if (forbidden && allocations)
+			violations.fetch_add(1, std::memory_order_relaxed);
+		auto& site = Find(name);
+		Add(site.total, allocations, bytes, copies, copiedBytes);
+		Add(site.update, allocations, bytes, copies, copiedBytes);
+		Add(totals, allocations, bytes, copies, copiedBytes);
+	}
+
+	void* Allocate(std::size_t n)
+	{
+		Charge(1, n, 0, 0);
+		if (auto p = std::malloc(n ? n : 1))
+			return p;
+		throw std::bad_alloc();
+	}
+
+	void* Allocate(std::size_t n, std::align_val_t align)
+	{
+		Charge(1, n, 0, 0);
+		auto a = static_cast<std::size_t>(align);
+		if (auto p = std::aligned_alloc(a, (std::max<std::size_t>(n, 1) + a - 1) / a * a))
+			return p;
+		throw std::bad_alloc();
+	}
+
+	void Free(void* p) noexcept
+	{
+		if (!p)
+			return;
+		if (!busy)
+			frees.fetch_add(1, std::memory_order_relaxed);
+		std::free(p);
+	}
+
+	struct Busy
+	{
+		Busy() noexcept { busy = true; }
+		~Busy() { busy = false; }
+	};
+
+	// report at exit, if anything was audited
+	struct AtExit
+	{
+		~AtExit()
+		{
+			if (totals.allocations.load() || totals.copies.load())
+				audit::Report(std::cerr);
+		}
+	} atExit;
+} // namespace
+
+void* operator new(std::size_t n) { return Allocate(n); }
+void* operator new[](std::size_t n) { return Allocate(n); }
+void* operator new(std::size_t n, std::align_val_t a) { return Allocate(n, a); }
+void* operator new[](std::size_t n, std::align_val_t a) { return Allocate(n, a); }
+void operator delete(void* p) noexcept { Free(p); }
+void operator delete[](void* p) noexcept { Free(p); }
+void operator delete(void* p, std::size_t) noexcept { Free(p); }
+void operator delete[](void* p, std::size_t) noexcept { Free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { Free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { Free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { Free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { Free(p); }
+
+namespace audit
+{
+	char const* Enter(char const* name) noexcept
+	{
+		auto previous = current;
+		current = name;
+		forbidden += name == audit::noAlloc;
+		return previous;
+	}
+
+	// scopes nest, so the one left is current
+	void Leave(char const* previous) noexcept
+	{
+		forbidden -= current == audit::noAlloc;
+		current = previous;
+	}
+
+	void Copy(std::size_t bytes) noexcept { Charge(0, 0, 1, bytes); }
+
+	void NextUpdate() noexcept
+	{
+		// everything before the first update is setup, it counts in totals only
+		bool first = updates.fetch_add(1) == 0;
+		for (auto& s : sites)
+		{
+			if (!s.name.load(std::memory_order_acquire))
+				break;
+			auto u = s.update.Load();
+			s.update.Clear();
+			if (first)
+				continue;
+			auto raise = [](std::atomic<std::size_t>& peak, std::size_t v) {
+				for (auto p = peak.load(); v > p && !peak.compare_exchange_weak(p, v);)
+					;
+			};
+			raise(s.peak.allocations, u.allocations);
+			raise(s.peak.bytes, u.bytes);
+			raise(s.peak.copies, u.copies);
+			raise(s.peak.copiedBytes, u.copiedBytes);
+		}
+	}
+
+	std::size_t Violations() noexcept { return violations.load(); }
+
+	Stats Snapshot()
+	{
+		Busy guard;
+		Stats res;
+		// the first call only opens the first update
+		res.updates = updates.load() > 0 ? updates.load() - 1 : 0;
+		res.frees = frees.load();
+		res.total = totals.Load();
+		for (auto& s : sites)
+		{
+			auto name = s.name.load(std::memory_order_acquire);
+			if (!name)
+				break;
+			res.sites.push_back({name, s.total.Load(), s.peak.Load()});
+		}
+		std::sort(res.sites.begin(), res.sites.end(), [](auto const& a, auto const& b) { return a.total.bytes + a.total.copiedBytes > b.total.bytes + b.total.copiedBytes; });
+		return res;
+	}
+
+	void Reset() noexcept
+	{
+		for (auto& s : sites)
+		{
+			s.total.Clear();
+			s.update.Clear();
+			s.peak.Clear();
+		}
+		totals.Clear();
+		updates = 0;
+		frees = 0;
+		violations = 0;
+	}
+
+	void Report(std::ostream& out)
+	{
+		auto stats = Snapshot();
+		Busy guard;
+		out << "allocation audit: " << stats.total.allocations << " allocations (" << stats.total.bytes << " bytes), "
+			<< stats.frees << " frees, " << stats.total.copies << " copies (" << stats.total.copiedBytes << " bytes), "
+			<< stats.updates << " updates";
+		if (auto v = Violations())
+			out << ", " << v << " allocations in no-alloc scopes";
+		out << '\n'
+			<< std::left << std::setw(32) << "site" << std::right
+			<< std::setw(12) << "allocs" << std::setw(14) << "bytes"
+			<< std::setw(10) << "copies" << std::setw(14) << "copied"
+			<< std::setw(14) << "peak allocs" << std::setw(14) << "peak bytes" << std::setw(14) << "peak copied" << '\n';
+		for (auto const& s : stats.sites)
+			out << std::left << std::setw(32) << s.name << std::right
+				<< std::setw(12) << s.total.allocations << std::setw(14) << s.total.bytes
+				<< std::setw(10) << s.total.copies << std::setw(14) << s.total.copiedBytes
+				<< std::setw(14) << s.peak.allocations << std::setw(14) << s.peak.bytes << std::setw(14) << s.peak.copiedBytes << '\n';
+		out << std::flush;
+	}
+} // namespace audit
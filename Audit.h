@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Allocation and copy audit, enabled by the PENDULUM_AUDIT build option.
+ * Global operator new/delete are replaced (Audit.cpp) and every allocation is
+ * charged to the innermost AUDIT_SCOPE of its thread; AUDIT_COPY charges bytes of
+ * state copied by hand. NextUpdate() closes one update (one frame in the viewer),
+ * so sites are reported per update as well as in total.
+ * Without the option the macros are empty and Snapshot() is empty.
+ */
+namespace audit
+{
+	struct Counts
+	{
+		std::size_t allocations = 0, bytes = 0, copies = 0, copiedBytes = 0;
+	};
+
+	struct Site
+	{
+		std::string name;
+		Counts total;
+		// largest single update
+		Counts peak;
+	};
+
+	struct Stats
+	{
+		std::size_t updates = 0;
+		std::size_t frees = 0;
+		Counts total;
+		std::vector<Site> sites;
+	};
+
+	// scope that allocations may not happen in, violations are counted and reported
+	inline constexpr char const* noAlloc = "(forbidden)";
+
+#ifdef PENDULUM_AUDIT
+	inline constexpr bool enabled = true;
+
+	// name must outlive the program, string literals are
+	char const* Enter(char const* name) noexcept;
+	void Leave(char const* previous) noexcept;
+	void Copy(std::size_t bytes) noexcept;
+	void NextUpdate() noexcept;
+	// allocations in noAlloc scopes since start
+	std::size_t Violations() noexcept;
+	Stats Snapshot();
+	void Reset() noexcept;
+	void Report(std::ostream& out);
+
+	class Scope
+	{
+	private:
+		char const* previous;
+
+	public:
+		explicit Scope(char const* name) noexcept
+		: previous(Enter(name))
+		{}
+		~Scope() { Leave(previous); }
+		Scope(Scope const&) = delete;
+		Scope& operator=(Scope const&) = delete;
+	};
+
+#define AUDIT_CONCAT_(a, b) a##b
+#define AUDIT_CONCAT(a, b) AUDIT_CONCAT_(a, b)
+#define AUDIT_SCOPE(name) ::audit::Scope AUDIT_CONCAT(auditScope, __LINE__)(name)
+#define AUDIT_NO_ALLOC() AUDIT_SCOPE(::audit::noAlloc)
+#define AUDIT_COPY(bytes) ::audit::Copy(bytes)
+#else
+	inline constexpr bool enabled = false;
+
+	inline void NextUpdate() noexcept {}
+	inline std::size_t Violations() noexcept { return 0; }
+	inline Stats Snapshot() { return {}; }
+	inline void Reset() noexcept {}
+	inline void Report(std::ostream&) {}
+
+#define AUDIT_SCOPE(name) ((void)0)
+#define AUDIT_NO_ALLOC() ((void)0)
+#define AUDIT_COPY(bytes) ((void)0)
+#endif
+} // namespace audit
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <variant>
+
+/*
+ * Picks the cheapest solver and step for a configuration and an error budget.
+ * Every solver runs a short calibration against an RK4 reference,
+ * halving its step until the error (max position deviation, extrapolated
+ * linearly from the calibration time to the horizon) fits the budget.
+ * Cost is solver stages per simulated second. Decisions are cached in a text file
+ * keyed by a hash of parameters, gravity, initial state, budget and horizon.
+ */
+namespace autotune
+{
+	// derivative evaluations per step
+	inline int Stages(Method m) noexcept { return m == Method::RungeKutta ? 4 : m == Method::Midpoint ? 2 : 1; }
+
+	struct Choice
+	{
+		Method method = Method::RungeKutta;
+		double step = 0;
+		// estimated over the horizon
+		double error = std::numeric_limits<double>::infinity();
+		bool found = false;
+
+		double Cost() const noexcept { return Stages(method) / step; }
+	};
+
+	inline void Step(Pendulum& pend, Choice const& c)
+	{
+		std::visit([&](auto const& s) { pend.Step(c.step, s); }, Solver(c.method));
+	}
+
+	class Tuner
+	{
+	private:
+		std::map<std::uint64_t, Choice> cache;
+
+		// bits of v through the splitmix64 finalizer: the same key on every platform and build,
+		// which std::hash does not promise for a cache file that outlives the program
+		static void Mix(std::uint64_t& h, double v) noexcept
+		{
+			h = (h ^ std::bit_cast<std::uint64_t>(v)) + 0x9e3779b97f4a7c15ull;
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+			h ^= h >> 31;
+		}
+
+		// positions at `samples` evenly spaced times
+		static std::vector<vec> Run(Pendulum pend, AnySolver const& solver, double step, double time, int samples)
+		{
+			std::vector<vec> out;
+			auto n = static_cast<std::size_t>(std::ceil(time / step - 1e-9));
+			auto h = time / n;
+			std::size_t next = 1;
+			for (std::size_t i = 1; i <= n; i++)
+			{
+				std::visit([&](auto const& s) { pend.Step(h, s); }, solver);
+				if (i * samples >= next * n)
+				{
+					for (std::size_t b = 0; b < pend.ballParams.size(); b++)
+						out.push_back(pend.ballCoords[b * 2]);
+					next++;
+				}
+			}
+			return out;
+		}
+
+		static double Error(std::vector<vec> const& a, std::vector<vec> const& b) noexcept
+		{
+			double e = 0;
+			for (std::size_t i = 0; i < a.size() && i < b.size(); i++)
+				e = std::max<double>(e, (a[i] - b[i]).Len());
+			return a.size() == b.size() ? e : std::numeric_limits<double>::infinity();
+		}
+
+	public:
+		std::string cachePath;
+		// simulated seconds of each calibration run, at most the horizon
+		double calibration = 2;
+		double maxStep = 0.1, minStep = 1e-5;
+		int samples = 16;
+
+		explicit Tuner(std::string cachePath = "autotune.cache")
+		: cachePath(std::move(cachePath))
+		{
+			std::ifstream in(this->cachePath);
+			std::string line;
+			while (std::getline(in, line))
+			{
+				std::istringstream ls(line);
+				std::uint64_t key;
+				int method;
+				Choice c;
+				// lines of another version or a damaged file are skipped
+				if (ls >> key >> method >> c.step >> c.error
+						&& method >= static_cast<int>(Method::RungeKutta) && method <= static_cast<int>(Method::Euler)
+						&& c.step > 0 && std::isfinite(c.step))
+				{
+					c.method = static_cast<Method>(method);
+					c.found = true;
+					cache[key] = c;
+				}
+			}
+		}
+
+		static std::uint64_t Key(Pendulum const& pend, double budget, double horizon) noexcept
+		{
+			std::uint64_t h = pend.ballParams.size();
+			for (auto const& b : pend.ballParams)
+			{
+				Mix(h, b.r);
+				Mix(h, b.m);
+				Mix(h, b.k);
+				Mix(h, b.rod);
+			}
+			for (auto const& v : pend.ballCoords)
+			{
+				Mix(h, v.X);
+				Mix(h, v.Y);
+				Mix(h, v.Z);
+			}
+			Mix(h, pend.g.X);
+			Mix(h, pend.g.Y);
+			Mix(h, pend.g.Z);
+			Mix(h, budget);
+			Mix(h, horizon);
+			return h;
+		}
+
+		// budget is max position error over horizon seconds, horizon must be positive
+		Choice Tune(Pendulum const& pend, double budget, double horizon)
+		{
+			if (!mth::IsFinite(horizon) || !(horizon > 0))
+				throw std::runtime_error("autotune: horizon must be positive");
+			auto key = Key(pend, budget, horizon);
+			if (auto it = cache.find(key); it != cache.end())
+				return it->second;
+
+			auto time = std::min(calibration, horizon);
+			auto scale = horizon / time;
+			// RK4 error drops 16x per halving, so this is well below the smallest tried step
+			auto reference = Run(pend, RungeKuttaSolver(), minStep / 4, time, samples);
+
+			Choice best;
+			for (auto m : {Method::RungeKutta, Method::Midpoint, Method::Euler})
+				for (auto step = maxStep; step >= minStep; step /= 2)
+				{
+					Choice c{m, step};
+					// cannot win anymore
+					if (best.found && c.Cost() >= best.Cost())
+						break;
+					c.error = Error(Run(pend, Solver(m), step, time, samples), reference) * scale;
+					if (c.error <= budget)
+					{
+						c.found = true;
+						best = c;
+						break;
+					}
+				}
+
+			if (best.found)
+			{
+				cache[key] = best;
+				std::ofstream out(cachePath, std::ios::app);
+				out.precision(17);
+				out << key << ' ' << static_cast<int>(best.method) << ' ' << best.step << ' ' << best.error << '\n';
+			}
+			return best;
+		}
+	};
+} // namespace autotune
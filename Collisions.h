@@ -0,0 +1,201 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+ * Contacts of balls with each other (within one chain and between pendulums)
+ * and with planes. Balls are spheres of Pendulum::Radius, as drawn.
+ * Resolve() runs after a step: overlapping pairs are pushed apart along the
+ * contact normal by inverse mass, approaching velocities get an impulse with
+ * restitution. Candidate pairs come from a uniform hash grid with cells of the
+ * largest diameter, so only balls in neighbouring cells are tested.
+ */
+class Collider
+{
+public:
+	using State = std::valarray<vec>;
+
+	// half space normal . x >= offset is free, normal is unit
+	struct Plane
+	{
+		vec normal = {0, 0, 1};
+		double offset = 0;
+		double restitution = 0.5;
+	};
+
+private:
+	struct Item
+	{
+		vec* x;
+		vec* v;
+		double w, r;
+		std::uint32_t owner, ball;
+	};
+	struct Cell
+	{
+		std::int64_t x, y, z;
+		bool operator==(Cell const&) const = default;
+	};
+
+	std::vector<Item> items;
+	std::vector<Cell> cells;
+	// counting sort of items by bucket: bucket b holds order[start[b] .. start[b + 1])
+	std::vector<std::uint32_t> bucketOf, start, order;
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> candidates;
+	std::size_t contacts = 0;
+
+	static std::size_t Hash(Cell const& c, std::size_t mask) noexcept
+	{
+		return (static_cast<std::uint64_t>(c.x) * 73856093u ^ static_cast<std::uint64_t>(c.y) * 19349663u
+				^ static_cast<std::uint64_t>(c.z) * 83492791u) & mask;
+	}
+
+	void Broadphase()
+	{
+		candidates.clear();
+		auto n = items.size();
+		if (!balls || n < 2)
+			return;
+		double size = 0;
+		for (auto const& it : items)
+			size = std::max(size, 2 * it.r);
+		size = std::max(size, 1e-9);
+
+		std::size_t buckets = 1;
+		while (buckets < 2 * n)
+			buckets *= 2;
+		auto mask = buckets - 1;
+		cells.resize(n);
+		bucketOf.resize(n);
+		order.resize(n);
+		start.assign(buckets + 1, 0);
+		for (std::size_t i = 0; i < n; i++)
+		{
+			auto const& x = *items[i].x;
+			cells[i] = {static_cast<std::int64_t>(std::floor(x.X / size)), static_cast<std::int64_t>(std::floor(x.Y / size)),
+					static_cast<std::int64_t>(std::floor(x.Z / size))};
+			bucketOf[i] = static_cast<std::uint32_t>(Hash(cells[i], mask));
+			start[bucketOf[i] + 1]++;
+		}
+		for (std::size_t b = 0; b < buckets; b++)
+			start[b + 1] += start[b];
+		for (std::size_t i = 0; i < n; i++)
+			order[start[bucketOf[i]]++] = static_cast<std::uint32_t>(i);
+		// filling advanced every start to the next bucket, shift back
+		for (std::size_t b = buckets; b > 0; b--)
+			start[b] = start[b - 1];
+		start[0] = 0;
+
+		for (std::uint32_t i = 0; i < n; i++)
+			for (int dx = -1; dx <= 1; dx++)
+				for (int dy = -1; dy <= 1; dy++)
+					for (int dz = -1; dz <= 1; dz++)
+					{
+						Cell c = {cells[i].x + dx, cells[i].y + dy, cells[i].z + dz};
+						auto b = Hash(c, mask);
+						for (auto k = start[b]; k < start[b + 1]; k++)
+						{
+							auto j = order[k];
+							// a pair once; hash collisions bring balls of other cells
+							if (j <= i || !(cells[j] == c))
+								continue;
+							auto const& a = items[i];
+							auto const& o = items[j];
+							if (!linked && a.owner == o.owner && (a.ball + 1 == o.ball || o.ball + 1 == a.ball))
+								continue;
+							candidates.emplace_back(i, j);
+						}
+					}
+	}
+
+	void Contact(Item const& a, Item const& b) noexcept
+	{
+		auto d = *b.x - *a.x;
+		auto dist2 = d.Len2();
+		auto reach = a.r + b.r;
+		if (dist2 >= reach * reach || dist2 == 0)
+			return;
+		contacts++;
+		auto dist = std::sqrt(dist2);
+		auto n = d / dist;
+		auto sum = a.w + b.w;
+		auto overlap = reach - dist;
+		*a.x -= n * (overlap * a.w / sum);
+		*b.x += n * (overlap * b.w / sum);
+		auto vn = (*b.v - *a.v) & n;
+		if (vn >= 0)
+			return;
+		auto j = -(1 + restitution) * vn / sum;
+		*a.v -= n * (j * a.w);
+		*b.v += n * (j * b.w);
+	}
+
+	void Planes() noexcept
+	{
+		for (auto const& p : planes)
+			for (auto const& it : items)
+			{
+				auto depth = it.r - ((*it.x & p.normal) - p.offset);
+				if (depth <= 0)
+					continue;
+				contacts++;
+				*it.x += p.normal * depth;
+				auto vn = *it.v & p.normal;
+				if (vn < 0)
+					*it.v -= p.normal * ((1 + p.restitution) * vn);
+			}
+	}
+
+	void Add(Pendulum const& params, State& state, std::uint32_t owner)
+	{
+		for (std::size_t i = 0; i < params.ballParams.size(); i++)
+			items.push_back({&state[i * 2], &state[i * 2 + 1], 1 / params.ballParams[i].m, params.Radius(i), owner, static_cast<std::uint32_t>(i)});
+	}
+
+	void Run()
+	{
+		contacts = 0;
+		Broadphase();
+		for (int it = 0; it < iterations; it++)
+		{
+			for (auto [i, j] : candidates)
+				Contact(items[i], items[j]);
+			Planes();
+		}
+	}
+
+public:
+	std::vector<Plane> planes;
+	// ball-ball restitution
+	double restitution = 0.8;
+	bool balls = true;
+	// also collide neighbours on one link, off by default: on short links their spheres overlap at rest
+	bool linked = false;
+	// relaxation passes over the contacts found once per Resolve
+	int iterations = 2;
+
+	// contacts resolved by the last call
+	std::size_t Contacts() const noexcept { return contacts; }
+
+	// params gives balls, state is as ballCoords
+	void Resolve(Pendulum const& params, State& state)
+	{
+		items.clear();
+		Add(params, state, 0);
+		Run();
+	}
+	void Resolve(Pendulum& pend) { Resolve(pend, pend.ballCoords); }
+	// several pendulums in one scene
+	void Resolve(std::vector<Pendulum*> const& pends)
+	{
+		items.clear();
+		for (std::size_t p = 0; p < pends.size(); p++)
+			Add(*pends[p], pends[p]->ballCoords, static_cast<std::uint32_t>(p));
+		Run();
+	}
+};
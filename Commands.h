@@ -0,0 +1,193 @@
+#pragma once
+
+#include "Equilibrium.h"
+#include "pendulum.h"
+
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+/*
+ * Editor commands read from a console stream on a background thread.
+ * Parsed commands are queued and applied by the simulation thread between steps,
+ * so neither rendering nor physics ever waits for input.
+ *
+ * add r k m       -- append a ball, m > 0, r >= 0, k >= 0
+ * pop             -- remove last ball
+ * set i r k m     -- change parameters of ball i (0 based), a rod stays a rod
+ * g x y z         -- set gravity
+ * settle [i x y z]... -- static equilibrium, balls i held at x y z (Equilibrium.h)
+ * pause / resume  -- freeze or unfreeze
+ */
+class CommandQueue
+{
+public:
+	struct AddBall { Pendulum::BallData data; };
+	struct PopBall {};
+	struct SetBall { std::size_t index; Pendulum::BallData data; };
+	struct SetGravity { vec g; };
+	struct Freeze { bool frozen; };
+	struct Settle { std::vector<equilibrium::Fixed> held; };
+	using Command = std::variant<AddBall, PopBall, SetBall, SetGravity, Freeze, Settle>;
+
+private:
+	// shared with the listening thread, which may outlive the queue
+	struct Inbox
+	{
+		std::mutex mutex;
+		std::deque<Command> queue;
+
+		void Push(Command cmd)
+		{
+			std::lock_guard lock(mutex);
+			queue.emplace_back(std::move(cmd));
+		}
+	};
+
+	std::shared_ptr<Inbox> inbox = std::make_shared<Inbox>();
+
+	// same limits as scenario::Validate, finiteness by bits as fast-math drops NaN checks
+	static bool Valid(Pendulum::BallData const& b)
+	{
+		return mth::IsFinite(b.r) && mth::IsFinite(b.k) && mth::IsFinite(b.m) && b.m > 0 && b.r >= 0 && b.k >= 0;
+	}
+
+	static bool Parse(std::string const& line, Command& cmd)
+	{
+		std::istringstream in(line);
+		std::string name;
+		if (!(in >> name))
+			return false;
+		if (name == "add")
+		{
+			AddBall c;
+			if (!(in >> c.data.r >> c.data.k >> c.data.m) || !Valid(c.data))
+				return false;
+			cmd = c;
+		}
+		else if (name == "pop")
+			cmd = PopBall();
+		else if (name == "set")
+		{
+			SetBall c;
+			if (!(in >> c.index >> c.data.r >> c.data.k >> c.data.m) || !Valid(c.data))
+				return false;
+			cmd = c;
+		}
+		else if (name == "g")
+		{
+			SetGravity c;
+			if (!(in >> c.g.X >> c.g.Y >> c.g.Z))
+				return false;
+			cmd = c;
+		}
+		else if (name == "settle")
+		{
+			Settle c;
+			equilibrium::Fixed f;
+			while (in >> f.ball)
+			{
+				if (!(in >> f.x.X >> f.x.Y >> f.x.Z))
+					return false;
+				c.held.push_back(f);
+			}
+			if (!in.eof())
+				return false;
+			cmd = c;
+		}
+		else if (name == "pause")
+			cmd = Freeze{true};
+		else if (name == "resume")
+			cmd = Freeze{false};
+		else
+			return false;
+		return true;
+	}
+
+public:
+	void Push(Command cmd) { inbox->Push(std::move(cmd)); }
+
+	/*
+	 * Reads commands until the stream ends. A blocked read cannot be interrupted, so
+	 * the thread is detached and owns the inbox with the queue: it stays valid when the
+	 * queue is destroyed first, commands read after that are dropped with it.
+	 * The stream must live until exit, as std::cin does.
+	 */
+	void Listen(std::istream& in = std::cin)
+	{
+		std::thread([inbox = inbox, &in]() {
+			std::string line;
+			while (std::getline(in, line))
+			{
+				if (line.find_first_not_of(" \t\r") == std::string::npos)
+					continue;
+				Command cmd;
+				if (Parse(line, cmd))
+					inbox->Push(std::move(cmd));
+				else
+					std::cerr << "bad command : " << line << std::endl;
+			}
+		}).detach();
+	}
+
+	// applies all queued commands, returns true if balls were edited
+	bool Apply(Pendulum& pend)
+	{
+		std::deque<Command> taken;
+		{
+			std::lock_guard lock(inbox->mutex);
+			taken.swap(inbox->queue);
+		}
+		bool edited = false;
+		for (auto const& cmd : taken)
+			std::visit([&](auto const& c) {
+						using T = std::decay_t<decltype(c)>;
+						if constexpr (std::is_same_v<T, AddBall>)
+						{
+							pend.AddBall(c.data);
+							edited = true;
+						}
+						else if constexpr (std::is_same_v<T, PopBall>)
+						{
+							if (pend.ballParams.empty())
+								return;
+							pend.PopBall();
+							edited = true;
+						}
+						else if constexpr (std::is_same_v<T, SetBall>)
+						{
+							if (c.index >= pend.ballParams.size())
+							{
+								std::cerr << "no ball " << c.index << std::endl;
+								return;
+							}
+							auto rod = pend.ballParams[c.index].rod;
+							pend.ballParams[c.index] = c.data;
+							pend.ballParams[c.index].rod = rod;
+							edited = true;
+						}
+						else if constexpr (std::is_same_v<T, SetGravity>)
+						{
+							pend.g = c.g;
+							edited = true;
+						}
+						else if constexpr (std::is_same_v<T, Settle>)
+						{
+							auto report = equilibrium::Solve(pend, c.held);
+							if (!report.converged)
+								std::cerr << "no equilibrium found, residual force " << report.residual << std::endl;
+							edited = true;
+						}
+						else
+							pend.frozen = c.frozen;
+					},
+					cmd);
+		return edited;
+	}
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+/*
+ * Runs several solvers side by side from one state.
+ * Parameters (balls and gravity) live in one immutable block shared by all lanes;
+ * a lane is only a state, its solver and the solver's scratch, so K solvers cost
+ * K state updates. After every step the engine updates, per lane, energy and
+ * oscillation phase, and per pair, position divergence, energy and phase difference.
+ *
+ * Phase counts turning points of one ball along one axis (velocity crossing zero
+ * from + to -): 2 pi per turn, interpolated linearly within the step and
+ * extrapolated by the last period between turns.
+ */
+class Comparison
+{
+public:
+	using State = std::valarray<vec>;
+	using Method = ::Method;
+
+	struct Lane
+	{
+		Method method;
+		AnySolver solver;
+		State state;
+		SolverWork<State> work;
+		double energy = 0;
+		// turning points so far, time of the last one, period between the last two
+		std::size_t turns = 0;
+		double lastTurn = 0, period = 0;
+		double signal = 0;
+
+		double Phase(double time) const noexcept
+		{
+			if (turns < 2 || period <= 0)
+				return 0;
+			return 2 * mth::PI * (turns + (time - lastTurn) / period);
+		}
+	};
+
+	struct Pair
+	{
+		std::size_t a, b;
+		// RMS of ball position differences, now and the largest so far
+		double divergence = 0, maxDivergence = 0;
+		// a minus b
+		double energy = 0, phase = 0;
+	};
+
+private:
+	std::shared_ptr<Pendulum const> params;
+	std::vector<Lane> lanes;
+	std::vector<Pair> pairs;
+	double time = 0;
+
+	double Signal(State const& s) const noexcept
+	{
+		return phaseBall < params->ballParams.size() ? s[phaseBall * 2 + 1] & phaseAxis : 0;
+	}
+
+	void Restart(State const& s)
+	{
+		time = 0;
+		for (auto& l : lanes)
+		{
+			l.state = s;
+			l.energy = params->ballParams.empty() ? 0 : params->Energy(s);
+			l.turns = 0;
+			l.lastTurn = l.period = 0;
+			l.signal = Signal(s);
+		}
+		for (auto& p : pairs)
+			p = {p.a, p.b};
+	}
+
+public:
+	std::size_t phaseBall = 0;
+	vec phaseAxis = {1, 0, 0};
+	// applied to every lane after its step, before metrics (collisions, see Collisions.h)
+	std::function<void(Pendulum const&, State&)> afterStep = nullptr;
+
+	explicit Comparison(std::vector<Method> const& methods = {Method::RungeKutta, Method::Midpoint, Method::Euler})
+	: params(std::make_shared<Pendulum const>())
+	{
+		for (auto m : methods)
+			lanes.push_back({m, Solver(m)});
+		for (std::size_t a = 0; a < lanes.size(); a++)
+			for (std::size_t b = a + 1; b < lanes.size(); b++)
+				pairs.push_back({a, b});
+	}
+
+	// new parameter block and state, the only place parameters are copied
+	void Reset(Pendulum const& pend)
+	{
+		auto p = std::make_shared<Pendulum>();
+		p->ballParams = pend.ballParams;
+		p->g = pend.g;
+		params = std::move(p);
+		Restart(pend.ballCoords);
+	}
+
+	// same parameters, every lane restarts from s
+	void SetState(State const& s) { Restart(s); }
+
+	void Step(double h)
+	{
+		auto const& pend = *params;
+		if (pend.ballParams.empty())
+			return;
+		auto fill = [&pend](State const& x, double delta, State& out) { pend.Derivative(x, delta, out); };
+		auto t0 = time;
+		time += h;
+		for (auto& l : lanes)
+		{
+			std::visit([&](auto const& s) { s.InPlace(fill, l.state, h, l.work); }, l.solver);
+			if (afterStep)
+				afterStep(pend, l.state);
+			l.energy = pend.Energy(l.state);
+			auto signal = Signal(l.state);
+			if (l.signal > 0 && signal <= 0)
+			{
+				auto at = t0 + h * l.signal / (l.signal - signal);
+				if (l.turns > 0)
+					l.period = at - l.lastTurn;
+				l.lastTurn = at;
+				l.turns++;
+			}
+			l.signal = signal;
+		}
+		auto balls = pend.ballParams.size();
+		for (auto& p : pairs)
+		{
+			auto const& a = lanes[p.a];
+			auto const& b = lanes[p.b];
+			double sum = 0;
+			for (std::size_t i = 0; i < balls; i++)
+				sum += (a.state[i * 2] - b.state[i * 2]).Len2();
+			p.divergence = std::sqrt(sum / balls);
+			p.maxDivergence = std::max(p.maxDivergence, p.divergence);
+			p.energy = a.energy - b.energy;
+			p.phase = a.Phase(time) - b.Phase(time);
+		}
+	}
+
+	Pendulum const& Params() const noexcept { return *params; }
+	std::vector<Lane> const& Lanes() const noexcept { return lanes; }
+	State const& StateOf(std::size_t lane) const noexcept { return lanes[lane].state; }
+	std::vector<Pair> const& Pairs() const noexcept { return pairs; }
+	double Time() const noexcept { return time; }
+
+	void Report(std::ostream& out) const
+	{
+		out << "t = " << time << '\n';
+		for (auto const& l : lanes)
+			out << "  " << Name(l.method) << ": energy " << l.energy << ", turns " << l.turns << '\n';
+		for (auto const& p : pairs)
+			out << "  " << Name(lanes[p.a].method) << " - " << Name(lanes[p.b].method)
+				<< ": divergence " << p.divergence << " (max " << p.maxDivergence << ")"
+				<< ", energy " << p.energy << ", phase " << p.phase << " rad\n";
+		out << std::flush;
+	}
+};
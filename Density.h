@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Ensemble.h"
+
+#include <cstdint>
+
+/*
+ * Ball positions of a whole ensemble binned into a 3D grid every frame.
+ * Workers bin their share of members into private grids, which are then summed
+ * cell range by cell range, also in parallel, so nothing is shared while counting.
+ * Cloud() turns occupied cells into points coloured on a heat scale of log density
+ * for additive drawing (draw::Cloud), which costs the same for 10^3 or 10^6 members.
+ */
+class Density
+{
+public:
+	struct Box
+	{
+		vec lo, hi;
+	};
+
+private:
+	std::size_t n;
+	Box box;
+	std::vector<std::uint32_t> cells;
+	std::vector<std::vector<std::uint32_t>> partial;
+	std::uint32_t peak = 0;
+	std::size_t outside = 0;
+	// x, y, z and r, g, b per occupied cell
+	std::vector<float> vertices, colors;
+
+public:
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// resolution cells along each axis of box
+	Density(std::size_t resolution, Box box)
+	: n(resolution), box(box), cells(n * n * n)
+	{}
+	explicit Density(std::size_t resolution = 64)
+	: Density(resolution, {vec(-1), vec(1)})
+	{}
+
+	// cube around the pivot reaching a stretched chain in any direction
+	static Box Around(Pendulum const& pend, double stretch = 1.5)
+	{
+		double reach = 0;
+		for (auto const& b : pend.ballParams)
+			reach += b.r;
+		for (std::size_t i = 0; i < pend.ballParams.size(); i++)
+			reach = std::max(reach, pend.ballCoords[i * 2].Len());
+		reach = std::max(reach * stretch, 1e-3);
+		return {vec(-reach), vec(reach)};
+	}
+
+	void SetBox(Box const& b) noexcept { box = b; }
+	Box const& Bounds() const noexcept { return box; }
+	std::size_t Resolution() const noexcept { return n; }
+	std::uint32_t Count(std::size_t x, std::size_t y, std::size_t z) const noexcept { return cells[(z * n + y) * n + x]; }
+	std::uint32_t Peak() const noexcept { return peak; }
+	// balls that fell outside the box in the last Accumulate
+	std::size_t Outside() const noexcept { return outside; }
+
+	// counts the balls of all members, replacing the previous counts
+	void Accumulate(Ensemble const& ens)
+	{
+		auto balls = ens.Params().ballParams.size();
+		auto workers = static_cast<unsigned>(std::min<std::size_t>(std::max(1u, threads), std::max<std::size_t>(1, ens.Size())));
+		partial.resize(workers);
+		std::vector<std::size_t> out(workers);
+		auto scale = vec(n / (box.hi.X - box.lo.X), n / (box.hi.Y - box.lo.Y), n / (box.hi.Z - box.lo.Z));
+		auto lo = box.lo;
+		ParallelFor(ens.Size(), workers, [&](std::size_t begin, std::size_t end, unsigned t) {
+			auto& grid = partial[t];
+			grid.assign(cells.size(), 0);
+			std::size_t miss = 0;
+			for (auto m = begin; m < end; m++)
+			{
+				auto const& s = ens.Member(m);
+				for (std::size_t i = 0; i < balls; i++)
+				{
+					auto const& x = s[i * 2];
+					// fast-math comparisons let NaN through, so non-finite positions are rejected by bits first
+					auto cx = (x.X - lo.X) * scale.X, cy = (x.Y - lo.Y) * scale.Y, cz = (x.Z - lo.Z) * scale.Z;
+					if (!mth::IsFinite(x) || !(cx >= 0 && cy >= 0 && cz >= 0 && cx < n && cy < n && cz < n))
+					{
+						miss++;
+						continue;
+					}
+					grid[(std::size_t(cz) * n + std::size_t(cy)) * n + std::size_t(cx)]++;
+				}
+			}
+			out[t] = miss;
+		});
+		std::vector<std::uint32_t> peaks(workers);
+		ParallelFor(cells.size(), workers, [&](std::size_t begin, std::size_t end, unsigned t) {
+			std::uint32_t top = 0;
+			for (auto c = begin; c < end; c++)
+			{
+				std::uint32_t sum = 0;
+				for (auto const& grid : partial)
+					sum += grid[c];
+				cells[c] = sum;
+				top = std::max(top, sum);
+			}
+			peaks[t] = top;
+		});
+		peak = *std::max_element(peaks.begin(), peaks.end());
+		outside = 0;
+		for (auto o : out)
+			outside += o;
+	}
+
+	/*
+	 * Points of occupied cells for additive drawing: vertices and colors, 3 floats each.
+	 * Brightness is log(1 + count) / log(1 + peak) times gain, black to red to yellow to white.
+	 */
+	std::size_t Cloud(float gain = 1)
+	{
+		vertices.clear();
+		colors.clear();
+		if (peak == 0)
+			return 0;
+		auto norm = gain / std::log1p(float(peak));
+		auto size = (box.hi - box.lo) / double(n);
+		for (std::size_t z = 0; z < n; z++)
+			for (std::size_t y = 0; y < n; y++)
+				for (std::size_t x = 0; x < n; x++)
+				{
+					auto c = cells[(z * n + y) * n + x];
+					if (c == 0)
+						continue;
+					auto heat = std::min(1.0f, std::log1p(float(c)) * norm) * 3;
+					vertices.insert(vertices.end(), {
+							float(box.lo.X + (x + 0.5) * size.X), float(box.lo.Y + (y + 0.5) * size.Y), float(box.lo.Z + (z + 0.5) * size.Z)});
+					colors.insert(colors.end(), {std::min(1.0f, heat), std::clamp(heat - 1, 0.0f, 1.0f), std::clamp(heat - 2, 0.0f, 1.0f)});
+				}
+		return vertices.size() / 3;
+	}
+	std::vector<float> const& Vertices() const noexcept { return vertices; }
+	std::vector<float> const& Colors() const noexcept { return colors; }
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+// GL comes first, from GL/glew.h or with GL_GLEXT_PROTOTYPES (offscreen export)
+#include <GL/gl.h>
+#include <GL/glu.h>
+
+#include <cmath>
+#include <vector>
+
+#include "pendulum.h"
+
+// fixed function drawing shared by the viewer and the offscreen export
+namespace draw
+{
+	inline void VertAt(vec const& v) noexcept
+	{
+		glVertex3f(v.X, v.Y, v.Z);
+	}
+
+	// coordinate axes at the suspension point
+	inline void Axes() noexcept
+	{
+		glDisable(GL_DEPTH_TEST);
+		glBegin(GL_LINES);
+			glLineWidth(1);
+			glColor3f(1, 0, 0);
+			glVertex3f(0, 0, 0);
+			glVertex3f(1, 0, 0);
+
+			glColor3f(0, 1, 0);
+			glVertex3f(0, 0, 0);
+			glVertex3f(0, 1, 0);
+
+			glColor3f(0, 0, 1);
+			glVertex3f(0, 0, 0);
+			glVertex3f(0, 0, 1);
+		glEnd();
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	// params from pend, positions from coords; selected is 1-based, 0 for none
+	inline void Pend(Pendulum const& pend, std::valarray<vec> const& coords, GLUquadricObj* quadObj, std::size_t selected = 0, bool edit = false)
+	{
+		glBegin(GL_LINE_STRIP);
+			glLineWidth(5);
+			glColor3f(0, 1, 1);
+			glVertex3f(0, 0, 0);
+			for (std::size_t i = 0; i < pend.ballParams.size(); i++)
+				VertAt(coords[i * 2]);
+		glEnd();
+		for (std::size_t i = 0; i < pend.ballParams.size(); i++)
+		{
+			glPushMatrix();
+				if (selected == i + 1)
+					glColor3f(1, !edit, 0);
+				else
+					glColor3f(1, 1, 1);
+				auto tr = coords[i * 2];
+				glTranslated(tr.X, tr.Y, tr.Z);
+				gluSphere(quadObj, pend.Radius(i), 10, 10);
+			glPopMatrix();
+		}
+	}
+
+	// additive points, 3 floats of position and of colour each (Density::Cloud)
+	inline void Cloud(std::vector<float> const& vertices, std::vector<float> const& colors, float size = 3) noexcept
+	{
+		glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_POINT_BIT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glDepthMask(GL_FALSE);
+		glPointSize(size);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_COLOR_ARRAY);
+		glVertexPointer(3, GL_FLOAT, 0, vertices.data());
+		glColorPointer(3, GL_FLOAT, 0, colors.data());
+		glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(vertices.size() / 3));
+		glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glPopAttrib();
+	}
+
+	// viewport, projection and orbit camera looking at height posz
+	inline void View(int width, int height, double camrad, double zang, double posz) noexcept
+	{
+		float ratio = height / (float)width;
+
+		// glFrustum(float left, float right, float bottom, float top, float near, float far);
+		glViewport(0, 0, width, height);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		glLoadIdentity();
+		glFrustum(-0.1, 0.1, -0.1 * ratio, 0.1 * ratio, 0.1, 1000);
+		gluLookAt(camrad * sin(zang), camrad * cos(zang), posz + 1,
+		          0, 0, posz,
+		          0, 0, 1);
+	}
+}
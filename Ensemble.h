@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Forces.h"
+#include "mth/philox.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// fn(begin, end, worker) over [0, count) cut into one contiguous range per worker
+template<typename F>
+void ParallelFor(std::size_t count, unsigned threads, F const& fn)
+{
+	threads = static_cast<unsigned>(std::min<std::size_t>(std::max(1u, threads), std::max<std::size_t>(1, count)));
+	if (threads == 1)
+	{
+		fn(std::size_t(0), count, 0u);
+		return;
+	}
+	std::vector<std::thread> pool;
+	pool.reserve(threads - 1);
+	for (unsigned t = 1; t < threads; t++)
+		pool.emplace_back([&, t] { fn(count * t / threads, count * (t + 1) / threads, t); });
+	fn(0, count / threads, 0u);
+	for (auto& th : pool)
+		th.join();
+}
+
+/*
+ * Many copies of one chain from slightly different starts.
+ * Parameters live in one shared block as in Comparison, a member is only its state,
+ * so a million members of a short chain fit in memory. Members step in parallel,
+ * each worker with its own solver scratch, without allocating.
+ * Randomness is per member: member m draws from stream m of mth::philox, so a seed
+ * gives the same ensemble and the same thermal noise for any number of threads.
+ */
+class Ensemble
+{
+public:
+	using State = std::valarray<vec>;
+
+private:
+	std::shared_ptr<Pendulum const> params;
+	std::vector<State> members;
+	std::vector<SolverWork<State>> work;
+	std::vector<forces::Thermal> baths;
+	AnySolver solver;
+	double step;
+	double time = 0, pending = 0;
+	std::uint64_t steps = 0;
+
+public:
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	// Advance takes at most this many steps per call, and stops after budget of wall time
+	// once it took one; the rest of dt is dropped, so a huge ensemble falls behind real time
+	// instead of taking ever longer frames. A single step is never split, see README.
+	std::size_t maxSteps = 8;
+	std::chrono::duration<double> budget{0.01};
+	// heat bath on every member, its stream is replaced by the member's
+	std::optional<forces::Thermal> thermal;
+
+	explicit Ensemble(double step = 1.0 / 240, Method method = Method::RungeKutta)
+	: params(std::make_shared<Pendulum const>()), solver(Solver(method)), step(step)
+	{}
+
+	// count members of pend, positions of all but the first moved by normal noise of sd spread
+	void Reset(Pendulum const& pend, std::size_t count, double spread, std::uint64_t seed = 1)
+	{
+		auto p = std::make_shared<Pendulum>();
+		p->ballParams = pend.ballParams;
+		p->g = pend.g;
+		params = std::move(p);
+		members.assign(count, pend.ballCoords);
+		mth::philox rng(seed);
+		auto balls = pend.ballParams.size();
+		ParallelFor(count, threads, [&](std::size_t begin, std::size_t end, unsigned) {
+			std::vector<double> noise(balls * 3);
+			for (auto m = std::max<std::size_t>(begin, 1); m < end; m++)
+			{
+				rng.Normal(m, 0, noise.data(), noise.size());
+				for (std::size_t i = 0; i < balls; i++)
+					members[m][i * 2] += vec(noise[i * 3], noise[i * 3 + 1], noise[i * 3 + 2]) * spread;
+			}
+		});
+		time = pending = 0;
+		steps = 0;
+	}
+
+	void Step(double h)
+	{
+		Step(h, nullptr);
+	}
+
+	// same, calling each(worker, m, state) right after member m stepped, while it is in cache; nullptr for none
+	template<typename E>
+	void Step(double h, E const& each)
+	{
+		auto const& pend = *params;
+		if (pend.ballParams.empty() || members.empty())
+			return;
+		auto fill = [&pend](State const& x, double delta, State& out) { pend.Derivative(x, delta, out); };
+		work.resize(std::max<std::size_t>(work.size(), threads));
+		baths.resize(thermal ? std::max<std::size_t>(baths.size(), threads) : 0);
+		ParallelFor(members.size(), threads, [&](std::size_t begin, std::size_t end, unsigned t) {
+			std::visit([&](auto const& s) {
+				if (!thermal)
+				{
+					for (auto m = begin; m < end; m++)
+					{
+						s.InPlace(fill, members[m], h, work[t]);
+						if constexpr (!std::is_null_pointer_v<E>)
+							each(t, m, std::as_const(members[m]));
+					}
+					return;
+				}
+				// copy assignment keeps the kicks' storage
+				auto& bath = baths[t] = *thermal;
+				auto noisy = [&](State const& x, double delta, State& out) { pend.Derivative(x, delta, out, forces::Accel(bath, time)); };
+				for (auto m = begin; m < end; m++)
+				{
+					bath.stream = m;
+					bath.Draw(steps, pend.ballParams.size(), h);
+					s.InPlace(noisy, members[m], h, work[t]);
+					if constexpr (!std::is_null_pointer_v<E>)
+						each(t, m, std::as_const(members[m]));
+				}
+			}, solver);
+		});
+		time += h;
+		steps++;
+	}
+
+	// fixed steps covering dt, see maxSteps and budget
+	void Advance(double dt)
+	{
+		using Clock = std::chrono::steady_clock;
+		pending += dt;
+		auto end = Clock::now() + budget;
+		std::size_t n = 0;
+		for (; pending >= step && n < maxSteps && (n == 0 || Clock::now() < end); n++, pending -= step)
+			Step(step);
+		if (pending >= step)
+			pending = std::min(pending, step);
+	}
+
+	Pendulum const& Params() const noexcept { return *params; }
+	std::size_t Size() const noexcept { return members.size(); }
+	State const& Member(std::size_t m) const noexcept { return members[m]; }
+	double Time() const noexcept { return time; }
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+ * Static equilibrium of the chain, to start without the bounce AddBall's unstretched
+ * springs give. Free of prescribed balls the chain hangs straight along g with every
+ * link stretched by the weight below it, which is exact and solved directly.
+ * With balls held at prescribed positions the springs are solved by Newton's method:
+ * ball i only feels links i and i + 1, so the tangent stiffness is block tridiagonal
+ * with 3x3 blocks and every iteration is one O(N) block elimination.
+ * Prescribed balls are moved from the hanging chain to their targets in load steps,
+ * halved while Newton fails, so far displacements converge too.
+ * Rods are treated as springs here, as by all solvers but RattleStepper.
+ *
+ *   equilibrium::Solve(pend, {{2, {1, 0, -3}}});   // ball 2 held at (1, 0, -3)
+ */
+namespace equilibrium
+{
+	struct Fixed
+	{
+		std::size_t ball;
+		vec x;
+	};
+
+	struct Options
+	{
+		// largest force left on a free ball, relative to the weight of the chain
+		double tolerance = 1e-10;
+		int maxIterations = 50;
+		int maxLoadSteps = 64;
+	};
+
+	struct Report
+	{
+		bool converged = false;
+		int iterations = 0;
+		int loadSteps = 0;
+		// largest force left on a free ball
+		double residual = 0;
+	};
+
+	// 3x3 block, row major
+	struct Block
+	{
+		double a[3][3] = {};
+
+		static Block Diag(double d) noexcept
+		{
+			Block b;
+			b.a[0][0] = b.a[1][1] = b.a[2][2] = d;
+			return b;
+		}
+		// stiffness of a spring of rest length l and stiffness k stretched to d
+		static Block Link(vec const& d, double l, double k) noexcept
+		{
+			auto len = d.Len();
+			auto b = Diag(k * (1 - l / len));
+			double u[3] = {d.X, d.Y, d.Z};
+			auto s = k * l / (len * len * len);
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 3; c++)
+					b.a[r][c] += s * u[r] * u[c];
+			return b;
+		}
+
+		vec operator*(vec const& v) const noexcept
+		{
+			return vec(a[0][0] * v.X + a[0][1] * v.Y + a[0][2] * v.Z,
+					a[1][0] * v.X + a[1][1] * v.Y + a[1][2] * v.Z,
+					a[2][0] * v.X + a[2][1] * v.Y + a[2][2] * v.Z);
+		}
+		Block operator*(Block const& o) const noexcept
+		{
+			Block b;
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 3; c++)
+					b.a[r][c] = a[r][0] * o.a[0][c] + a[r][1] * o.a[1][c] + a[r][2] * o.a[2][c];
+			return b;
+		}
+		Block& operator-=(Block const& o) noexcept
+		{
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 3; c++)
+					a[r][c] -= o.a[r][c];
+			return *this;
+		}
+		Block& operator+=(Block const& o) noexcept
+		{
+			for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 3; c++)
+					a[r][c] += o.a[r][c];
+			return *this;
+		}
+		// adjugate over determinant, false if singular
+		bool Invert(Block& out) const noexcept
+		{
+			auto& o = out.a;
+			o[0][0] = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+			o[0][1] = a[0][2] * a[2][1] - a[0][1] * a[2][2];
+			o[0][2] = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+			o[1][0] = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+			o[1][1] = a[0][0] * a[2][2] - a[0][2] * a[2][0];
+			o[1][2] = a[0][2] * a[1][0] - a[0][0] * a[1][2];
+			o[2][0] = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+			o[2][1] = a[0][1] * a[2][0] - a[0][0] * a[2][1];
+			o[2][2] = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+			auto det = a[0][0] * o[0][0] + a[0][1] * o[1][0] + a[0][2] * o[2][0];
+			if (!(std::abs(det) > 0) || !std::isfinite(det))
+				return false;
+			for (auto& row : o)
+				for (auto& x : row)
+					x /= det;
+			return true;
+		}
+	};
+
+	/*
+	 * Straight chain along g with every link carrying the weight below it, velocities zeroed.
+	 * Without gravity links keep their rest length, downwards as AddBall puts them.
+	 * False if a link has no stiffness to carry the weight below it.
+	 */
+	inline bool Hanging(Pendulum& pend)
+	{
+		auto n = pend.ballParams.size();
+		auto gl = pend.g.Len();
+		auto down = gl > 0 ? pend.g / gl : vec(0, 0, -1);
+		std::vector<double> tension(n);
+		double below = 0;
+		for (std::size_t j = n; j-- > 0;)
+		{
+			below += pend.ballParams[j].m;
+			tension[j] = below * gl;
+		}
+		vec x = vec(0);
+		for (std::size_t j = 0; j < n; j++)
+		{
+			auto k = pend.LinkStiffness(j);
+			if (tension[j] > 0 && !(k > 0))
+				return false;
+			x += down * (pend.LinkLength(j) + (tension[j] > 0 ? tension[j] / k : 0));
+			pend.ballCoords[j * 2] = x;
+			pend.ballCoords[j * 2 + 1] = vec(0);
+		}
+		return true;
+	}
+
+	// net force on every ball of pend at positions x, largest over free balls
+	inline double Residual(Pendulum const& pend, std::vector<vec> const& x, std::vector<char> const& fixed, std::vector<vec>& force)
+	{
+		auto n = pend.ballParams.size();
+		force.resize(n);
+		double worst = 0;
+		vec up = pend.LinkForce(0, x[0]);
+		for (std::size_t i = 0; i < n; i++)
+		{
+			auto down = i + 1 < n ? pend.LinkForce(i + 1, x[i + 1] - x[i]) : vec(0);
+			force[i] = fixed[i] ? vec(0) : up - down + pend.g * pend.ballParams[i].m;
+			worst = std::max(worst, force[i].Len());
+			up = down;
+		}
+		return worst;
+	}
+
+	class Solver
+	{
+	private:
+		// elimination of K dx = f: diagonal blocks reduced to their inverses, upper blocks times them
+		std::vector<Block> inv, upper;
+		std::vector<vec> x, trial, force, trialForce, rhs, dx;
+		std::vector<char> fixed;
+
+		// one Newton step at x, fills dx; false if the stiffness is singular
+		bool Direction(Pendulum const& pend, double regularize)
+		{
+			auto n = x.size();
+			inv.resize(n);
+			upper.resize(n);
+			rhs.resize(n);
+			dx.resize(n);
+			Block link = Block::Link(x[0], pend.LinkLength(0), pend.LinkStiffness(0));
+			for (std::size_t i = 0; i < n; i++)
+			{
+				auto next = i + 1 < n ? Block::Link(x[i + 1] - x[i], pend.LinkLength(i + 1), pend.LinkStiffness(i + 1)) : Block();
+				Block d;
+				vec f = force[i];
+				// a prescribed ball is an identity row with zero right side, couplings to it vanish
+				bool free = !fixed[i];
+				Block up = free && i + 1 < n && !fixed[i + 1] ? Block::Diag(0) -= next : Block();
+				if (free)
+				{
+					d = link;
+					d += next;
+					d += Block::Diag(regularize);
+					if (i > 0 && !fixed[i - 1])
+					{
+						// lower block is -link, eliminate it with the row above
+						d += link * upper[i - 1];
+						f += link * rhs[i - 1];
+					}
+				}
+				else
+				{
+					d = Block::Diag(1);
+					f = vec(0);
+				}
+				if (!d.Invert(inv[i]))
+					return false;
+				upper[i] = inv[i] * up;
+				rhs[i] = inv[i] * f;
+				link = next;
+			}
+			for (std::size_t i = n; i-- > 0;)
+				dx[i] = i + 1 < n ? rhs[i] - upper[i] * dx[i + 1] : rhs[i];
+			return true;
+		}
+
+		// Newton with backtracking from x, true once the residual is below tol
+		bool Newton(Pendulum const& pend, double tol, double regularize, Options const& opt, Report& report)
+		{
+			auto worst = Residual(pend, x, fixed, force);
+			for (int it = 0; it < opt.maxIterations; it++)
+			{
+				if (worst <= tol)
+					return true;
+				report.iterations++;
+				if (!Direction(pend, regularize))
+					return false;
+				// halve the step while it does not reduce the largest force
+				bool better = false;
+				for (double alpha = 1; alpha > 1.0 / 1024; alpha /= 2)
+				{
+					for (std::size_t i = 0; i < x.size(); i++)
+						trial[i] = x[i] + dx[i] * alpha;
+					auto w = Residual(pend, trial, fixed, trialForce);
+					if (std::isfinite(w) && w < worst)
+					{
+						x.swap(trial);
+						force.swap(trialForce);
+						worst = w;
+						better = true;
+						break;
+					}
+				}
+				if (!better)
+					return false;
+			}
+			return worst <= tol;
+		}
+
+	public:
+		/*
+		 * Moves pend to the equilibrium with balls in prescribed held at their positions,
+		 * velocities zeroed. pend is left hanging, or at the last converged load step, if not converged.
+		 */
+		Report Solve(Pendulum& pend, std::vector<Fixed> const& prescribed = {}, Options const& opt = {})
+		{
+			AUDIT_SCOPE("equilibrium::Solve");
+			Report report;
+			auto n = pend.ballParams.size();
+			if (n == 0)
+			{
+				report.converged = true;
+				return report;
+			}
+			if (!Hanging(pend) && prescribed.empty())
+				return report;
+			x.resize(n);
+			trial.resize(n);
+			for (std::size_t i = 0; i < n; i++)
+				x[i] = pend.ballCoords[i * 2];
+			fixed.assign(n, 0);
+			for (auto const& p : prescribed)
+				if (p.ball < n)
+					fixed[p.ball] = 1;
+
+			double weight = 0, stiff = 0, reach = 0;
+			for (std::size_t i = 0; i < n; i++)
+			{
+				weight += pend.ballParams[i].m * pend.g.Len();
+				stiff = std::max(stiff, pend.LinkStiffness(i));
+				reach += pend.LinkLength(i);
+			}
+			auto tol = opt.tolerance * std::max({weight, stiff * reach, 1e-300});
+			// keeps links without tension (no g, a free tail) from making the stiffness singular
+			auto regularize = 1e-12 * std::max(stiff, 1e-300);
+
+			std::vector<vec> start(n);
+			for (std::size_t i = 0; i < n; i++)
+				start[i] = x[i];
+			auto place = [&](double s) {
+				for (auto const& p : prescribed)
+					if (p.ball < n)
+						x[p.ball] = start[p.ball] + (p.x - start[p.ball]) * s;
+			};
+			double done = 0, step = 1;
+			std::vector<vec> saved = x;
+			while (report.loadSteps < opt.maxLoadSteps)
+			{
+				auto s = std::min(1.0, done + step);
+				saved = x;
+				place(s);
+				report.loadSteps++;
+				if (Newton(pend, tol, regularize, opt, report))
+				{
+					done = s;
+					if (done == 1)
+					{
+						report.converged = true;
+						break;
+					}
+					step *= 2;
+				}
+				else
+				{
+					x = saved;
+					step /= 2;
+				}
+			}
+			report.residual = Residual(pend, x, fixed, force);
+			for (std::size_t i = 0; i < n; i++)
+			{
+				pend.ballCoords[i * 2] = x[i];
+				pend.ballCoords[i * 2 + 1] = vec(0);
+			}
+			return report;
+		}
+	};
+
+	inline Report Solve(Pendulum& pend, std::vector<Fixed> const& prescribed = {}, Options const& opt = {})
+	{
+		Solver s;
+		return s.Solve(pend, prescribed, opt);
+	}
+} // namespace equilibrium
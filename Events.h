@@ -0,0 +1,200 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Event detection for fixed steps.
+ * Every event is a function of time and state, it happens when the function changes sign.
+ * After each step all functions are checked at step ends; on a sign change the crossing
+ * is located on the step's cubic Hermite interpolant (no extra solver stages),
+ * so precise event times cost two derivative evaluations per step, not a smaller step.
+ */
+class EventStepper
+{
+public:
+	using State = std::valarray<vec>;
+
+	enum class Direction
+	{
+		Any,
+		Rising,
+		Falling,
+	};
+
+	struct Event
+	{
+		std::string name;
+		std::function<double(double, State const&)> fn;
+		Direction direction = Direction::Any;
+		// stepping stops at the event, the rest of the step is dropped
+		bool terminal = false;
+		// called with state integrated exactly to the event, may change it
+		std::function<void(double, Pendulum&)> action = nullptr;
+	};
+
+	struct Occurrence
+	{
+		std::size_t event;
+		double time;
+		State state;
+	};
+
+	// ball crosses plane (x - point) . normal = 0
+	static Event PlaneCrossing(std::size_t ball, vec normal, vec point = vec(0), Direction dir = Direction::Any)
+	{
+		return {"plane", [=](double, State const& s) { return (s[ball * 2] - point) & normal; }, dir};
+	}
+	// velocity component of ball along axis changes sign
+	static Event VelocitySign(std::size_t ball, vec axis, Direction dir = Direction::Any)
+	{
+		return {"velocity", [=](double, State const& s) { return s[ball * 2 + 1] & axis; }, dir};
+	}
+	// link above ball stops growing (its length is at a local maximum)
+	static Event MaxExtension(std::size_t ball)
+	{
+		return {"extension",
+				[=](double, State const& s) {
+					auto d = ball == 0 ? s[0] : s[ball * 2] - s[ball * 2 - 2];
+					auto dv = ball == 0 ? s[1] : s[ball * 2 + 1] - s[ball * 2 - 1];
+					return d & dv;
+				},
+				Direction::Falling};
+	}
+
+private:
+	std::vector<Event> events;
+	std::vector<Occurrence> log;
+	double time = 0;
+	// derivative at the end of the previous step, reused while state is untouched
+	State last, lastDeriv;
+	State x0, d0, d1, probe;
+
+	bool Crossed(Direction dir, double g0, double g1) const noexcept
+	{
+		bool rising = g0 < 0 && g1 >= 0;
+		bool falling = g0 > 0 && g1 <= 0;
+		return dir == Direction::Rising ? rising : dir == Direction::Falling ? falling : rising || falling;
+	}
+
+	// cubic Hermite on [0, 1]: x by x', v by a
+	void Interpolate(State const& xa, State const& da, State const& xb, State const& db, double h, double s, State& out) const
+	{
+		auto s2 = s * s, s3 = s2 * s;
+		auto h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s, h01 = -2 * s3 + 3 * s2, h11 = s3 - s2;
+		out.resize(xa.size());
+		for (std::size_t i = 0; i < xa.size(); i++)
+			out[i] = xa[i] * h00 + da[i] * (h10 * h) + xb[i] * h01 + db[i] * (h11 * h);
+	}
+
+	static bool Same(State const& a, State const& b) noexcept
+	{
+		if (a.size() != b.size())
+			return false;
+		for (std::size_t i = 0; i < a.size(); i++)
+			if (a[i] != b[i])
+				return false;
+		return true;
+	}
+
+public:
+	double tolerance = 1e-12;
+
+	double Time() const noexcept { return time; }
+	void SetTime(double t) noexcept { time = t; }
+	std::size_t Add(Event ev)
+	{
+		events.emplace_back(std::move(ev));
+		return events.size() - 1;
+	}
+	Event const& Get(std::size_t i) const noexcept { return events[i]; }
+	std::vector<Occurrence> const& Log() const noexcept { return log; }
+	void ClearLog() noexcept { log.clear(); }
+
+	// returns true when a terminal event stopped the step
+	template<typename S = RungeKuttaSolver>
+	bool Step(Pendulum& pend, double h, S const& solver = S())
+	{
+		if (pend.ballParams.empty())
+			return false;
+		x0 = pend.ballCoords;
+		if (Same(x0, last))
+			d0 = lastDeriv;
+		else
+			d0 = pend.Derivative(x0, 0);
+		auto t0 = time;
+		auto logged = log.size();
+		pend.Step(h, solver);
+		auto const& x1 = pend.ballCoords;
+		d1 = pend.Derivative(x1, 0);
+		last = x1;
+		lastDeriv = d1;
+		time = t0 + h;
+
+		// earliest crossing, as a fraction of the step
+		std::size_t first = events.size();
+		double firstAt = 2;
+		for (std::size_t e = 0; e < events.size(); e++)
+		{
+			auto const& ev = events[e];
+			auto g0 = ev.fn(t0, x0), g1 = ev.fn(time, x1);
+			if (!Crossed(ev.direction, g0, g1))
+				continue;
+			// Illinois, keeping the bracket so `hi` is already past the crossing
+			double lo = 0, hi = 1, glo = g0, ghi = g1;
+			int side = 0;
+			while ((hi - lo) * h > tolerance)
+			{
+				auto s = (lo * ghi - hi * glo) / (ghi - glo);
+				if (!(s > lo && s < hi))
+					s = (lo + hi) / 2;
+				Interpolate(x0, d0, x1, d1, h, s, probe);
+				auto gs = ev.fn(t0 + s * h, probe);
+				if ((gs < 0) == (glo < 0) && gs != 0)
+				{
+					lo = s;
+					glo = gs;
+					if (side == -1)
+						ghi /= 2;
+					side = -1;
+				}
+				else
+				{
+					hi = s;
+					ghi = gs;
+					if (side == 1)
+						glo /= 2;
+					side = 1;
+				}
+			}
+			Interpolate(x0, d0, x1, d1, h, hi, probe);
+			log.push_back({e, t0 + hi * h, probe});
+			if ((ev.terminal || ev.action) && hi < firstAt)
+			{
+				first = e;
+				firstAt = hi;
+			}
+		}
+		if (first == events.size())
+			return false;
+
+		// redo the step up to the event so the state is as exact as the solver
+		auto const& ev = events[first];
+		pend.ballCoords = x0;
+		auto tau = firstAt * h;
+		pend.Step(tau, solver);
+		time = t0 + tau;
+		// crossings after the handled one are not valid anymore
+		log.erase(std::remove_if(log.begin() + logged, log.end(), [&](auto const& o) { return o.time > time; }), log.end());
+		if (ev.action)
+			ev.action(time, pend);
+		if (ev.terminal)
+			return true;
+		return h - tau > 0 && Step(pend, h - tau, solver);
+	}
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "mth/dual.h"
+#include "pendulum.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*
+ * Loss and gradient of a simulated trajectory against a recorded one,
+ * for fitting BallData and initial state to measurements.
+ * Gradients are forward mode: the pendulum and solver run on dual numbers
+ * carrying C derivatives at once, so one pass covers C parameters and
+ * the whole gradient takes ceil(9 N / C) passes.
+ *
+ * Parameter order: r, m, k of every ball, then x, v of every ball (3 components each).
+ */
+namespace fit
+{
+	inline std::size_t Parameters(std::size_t balls) noexcept { return balls * 9; }
+
+	struct Reference
+	{
+		double step = 0;
+		// steps between samples, sample s is taken after (s + 1) * stride steps
+		std::size_t stride = 1;
+		std::vector<std::vector<vec>> positions;
+	};
+
+	struct Gradient
+	{
+		// mean squared position error over samples and balls
+		double loss = 0;
+		std::vector<double> d;
+	};
+
+	template<typename S = RungeKuttaSolver>
+	Reference Record(Pendulum pend, double step, std::size_t stride, std::size_t samples, S const& solver = S())
+	{
+		Reference ref{step, stride};
+		for (std::size_t s = 0; s < samples; s++)
+		{
+			for (std::size_t i = 0; i < stride; i++)
+				pend.Step(step, solver);
+			auto& frame = ref.positions.emplace_back();
+			for (std::size_t b = 0; b < pend.ballParams.size(); b++)
+				frame.push_back(pend.ballCoords[b * 2]);
+		}
+		return ref;
+	}
+
+	// derivatives by parameters [first, first + C)
+	template<int C, typename S>
+	void Pass(Pendulum const& pend, Reference const& ref, std::size_t first, S const& solver, Gradient& out)
+	{
+		using D = mth::dual<double, C>;
+		using dvec = mth::vec<D>;
+		auto n = pend.ballParams.size();
+		auto var = [&](double v, std::size_t index) { return D::Variable(v, static_cast<int>(index) - static_cast<int>(first)); };
+
+		BasicPendulum<D> dp;
+		dp.g = dvec(pend.g);
+		dp.ballParams.resize(n);
+		dp.ballCoords.resize(n * 2);
+		for (std::size_t b = 0; b < n; b++)
+		{
+			auto const& bd = pend.ballParams[b];
+			dp.ballParams[b] = {var(bd.r, b * 3), var(bd.m, b * 3 + 1), var(bd.k, b * 3 + 2), bd.rod};
+			for (std::size_t c = 0; c < 2; c++)
+			{
+				auto const& v = pend.ballCoords[b * 2 + c];
+				auto base = n * 3 + b * 6 + c * 3;
+				dp.ballCoords[b * 2 + c] = dvec(var(v.X, base), var(v.Y, base + 1), var(v.Z, base + 2));
+			}
+		}
+
+		D loss = 0;
+		for (auto const& frame : ref.positions)
+		{
+			for (std::size_t i = 0; i < ref.stride; i++)
+				dp.Step(ref.step, solver);
+			for (std::size_t b = 0; b < n && b < frame.size(); b++)
+			{
+				auto diff = dp.ballCoords[b * 2] - dvec(frame[b]);
+				loss += diff & diff;
+			}
+		}
+		if (!ref.positions.empty())
+			loss /= static_cast<double>(ref.positions.size() * n);
+
+		// passes of one set may run in parallel, all into out; the value is the same in each
+		if (first == 0)
+			out.loss = loss.V;
+		for (int i = 0; i < C && first + i < out.d.size(); i++)
+			out.d[first + i] = loss.D[i];
+	}
+
+	template<int C = 8, typename S = RungeKuttaSolver>
+	Gradient LossGradient(Pendulum const& pend, Reference const& ref, S const& solver = S())
+	{
+		Gradient res;
+		res.d.assign(Parameters(pend.ballParams.size()), 0);
+		for (std::size_t first = 0; first < res.d.size(); first += C)
+			Pass<C>(pend, ref, first, solver, res);
+		return res;
+	}
+
+	// every set is split into C-parameter passes, all passes share one thread pool
+	template<int C = 8, typename S = RungeKuttaSolver>
+	std::vector<Gradient> LossGradients(std::vector<Pendulum> const& sets,
+			Reference const& ref,
+			S const& solver = S(),
+			unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+	{
+		std::vector<Gradient> res(sets.size());
+		std::vector<std::pair<std::size_t, std::size_t>> jobs;
+		for (std::size_t s = 0; s < sets.size(); s++)
+		{
+			res[s].d.assign(Parameters(sets[s].ballParams.size()), 0);
+			for (std::size_t first = 0; first < res[s].d.size(); first += C)
+				jobs.emplace_back(s, first);
+		}
+		std::atomic<std::size_t> next = 0;
+		auto worker = [&]() {
+					for (std::size_t j; (j = next++) < jobs.size();)
+						Pass<C>(sets[jobs[j].first], ref, jobs[j].second, solver, res[jobs[j].first]);
+				};
+		std::vector<std::thread> pool;
+		for (unsigned t = 1; t < std::min<std::size_t>(threads, jobs.size()); t++)
+			pool.emplace_back(worker);
+		worker();
+		for (auto& t : pool)
+			t.join();
+		return res;
+	}
+} // namespace fit
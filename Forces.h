@@ -0,0 +1,228 @@
+#pragma once
+
+#include "pendulum.h"
+#include "mth/philox.h"
+
+#include <cassert>
+#include <concepts>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+/*
+ * Force terms on top of springs and g, composed at compile time.
+ * A term is bound once per solver stage, term.At(t), which does the work that only
+ * depends on time; the bound term maps a ball to an acceleration. Pipeline<A, B, ...>
+ * binds all its terms and sums them in a fold that Pendulum::Derivative inlines into
+ * its loop over balls, so a stack of terms costs no dispatch and no extra pass.
+ * Positions are relative to the pivot, so a driven pivot is an inertial force.
+ *
+ *   forces::Pipeline<forces::Damping, forces::Drag> air{{0.05}, {}};
+ *   forces::Step(pend, air, t, h);
+ *
+ * Preset is a variant of ready pipelines for a choice at runtime; Step visits
+ * it once per step, each alternative is fused as above.
+ * Thermal is not among them, its noise is drawn per step with Draw before stepping.
+ */
+namespace forces
+{
+	// what a term sees of one ball
+	template<typename T = double>
+	struct Ball
+	{
+		std::size_t index;
+		mth::vec<T> const& x;
+		mth::vec<T> const& v;
+		T m;
+	};
+
+	template<typename F, typename T = double>
+	concept Term = requires(F const& f, T t, Ball<T> const& b) {
+		{ f.At(t)(b) } -> std::convertible_to<mth::vec<T>>;
+	};
+
+	// linear viscous damping, force -c v
+	struct Damping
+	{
+		double c = 0.1;
+
+		template<typename T>
+		auto At(T) const noexcept
+		{
+			return [c = c](Ball<T> const& b) { return b.v * (-c / b.m); };
+		}
+	};
+
+	/*
+	 * Quadratic air drag on the ball's sphere (Pendulum::Radius),
+	 * force -density cd area |u| u / 2 with u the velocity relative to the wind.
+	 * Wind blows at `wind` plus gusts of `gust` sin(2 pi frequency t).
+	 */
+	struct Drag
+	{
+		double density = 1.2, cd = 0.47;
+		vec wind = {0, 0, 0};
+		vec gust = {0, 0, 0};
+		double frequency = 0;
+
+		template<typename T>
+		auto At(T t) const noexcept
+		{
+			auto w = wind + gust * std::sin(2 * mth::PI * frequency * t);
+			auto c = density * cd * mth::PI / 200;
+			return [air = mth::vec<T>(w.X, w.Y, w.Z), c](Ball<T> const& b) {
+				auto u = b.v - air;
+				// r = cbrt(m) / 10, area / m = pi / 100 / cbrt(m)
+				return u * (-c * u.Len() / std::cbrt(b.m));
+			};
+		}
+	};
+
+	// pivot moving as amplitude sin(2 pi frequency t): every ball feels minus its acceleration
+	struct DrivenPivot
+	{
+		vec amplitude = {0, 0, 0.05};
+		double frequency = 1;
+
+		template<typename T>
+		auto At(T t) const noexcept
+		{
+			auto w = 2 * mth::PI * frequency;
+			auto s = w * w * std::sin(w * t);
+			return [a = mth::vec<T>(amplitude.X * s, amplitude.Y * s, amplitude.Z * s)](Ball<T> const&) { return a; };
+		}
+	};
+
+	// the same force on every ball, e.g. a uniform electric field on equal charges
+	struct Uniform
+	{
+		vec force = {0, 0, 0};
+
+		template<typename T>
+		auto At(T) const noexcept
+		{
+			return [f = mth::vec<T>(force.X, force.Y, force.Z)](Ball<T> const& b) { return f / b.m; };
+		}
+	};
+
+	/*
+	 * Langevin heat bath at temperature kT (energy units): friction -gamma m v and random
+	 * kicks of variance 2 gamma m kT / h per step, so balls settle to kT per degree of freedom.
+	 * Kicks are drawn once per step by Draw(n, balls, h) from stream of rng and held through
+	 * all stages of the step; step n of a stream is always the same noise, see mth::philox.
+	 * h is the step about to be taken, the variance is only right for that step.
+	 */
+	struct Thermal
+	{
+		double gamma = 0.5, kT = 1e-3;
+		// step the kicks are drawn for, set by Draw
+		double h = 1.0 / 240;
+		mth::philox rng = mth::philox(1);
+		std::uint64_t stream = 0;
+		// unit normals, 3 per ball
+		std::vector<double> kicks;
+
+		// step n draws from block (n + 1) 2^32 on, the first 2^32 are left for initial conditions
+		void Draw(std::uint64_t n, std::size_t balls, double step)
+		{
+			h = step;
+			kicks.resize(balls * 3);
+			rng.Normal(stream, (n + 1) << 32, kicks.data(), kicks.size());
+		}
+
+		template<typename T>
+		auto At(T) const noexcept
+		{
+			return [gamma = gamma, c = 2 * gamma * kT / h, k = kicks.data(), size = kicks.size()](Ball<T> const& b) {
+				assert(b.index * 3 + 3 <= size && "Thermal::Draw was not called for this many balls");
+				auto s = std::sqrt(c / b.m);
+				auto const* kick = k + b.index * 3;
+				return mth::vec<T>(kick[0] * s, kick[1] * s, kick[2] * s) - b.v * gamma;
+			};
+		}
+	};
+
+	// any field given as f(x, v, t) -> force, inlined like the others
+	template<typename F>
+	struct Field
+	{
+		F f;
+
+		template<typename T>
+		auto At(T t) const noexcept
+		{
+			return [this, t](Ball<T> const& b) { return f(b.x, b.v, t) / b.m; };
+		}
+	};
+	template<typename F>
+	Field(F) -> Field<F>;
+
+	template<typename... Terms>
+	struct Pipeline
+	{
+		std::tuple<Terms...> terms;
+
+		Pipeline() = default;
+		explicit Pipeline(Terms... terms) requires (sizeof...(Terms) > 0)
+		: terms(std::move(terms)...)
+		{}
+
+		template<typename T>
+		auto At(T t) const
+		{
+			static_assert((Term<Terms, T> && ...), "a force term has At(t) returning a(Ball<T>) -> vec");
+			return std::apply([t](auto const&... term) {
+				return [... bound = term.At(t)](Ball<T> const& b) { return (mth::vec<T>(0) + ... + bound(b)); };
+			}, terms);
+		}
+	};
+
+	using Preset = std::variant<
+			Pipeline<>,
+			Pipeline<Damping>,
+			Pipeline<Damping, Drag>,
+			Pipeline<DrivenPivot, Damping>,
+			Pipeline<DrivenPivot, Damping, Drag>>;
+
+	inline char const* const presetNames[] = {"none", "damped", "air", "driven", "driven-air"};
+
+	inline Preset MakePreset(std::string const& name)
+	{
+		if (name == "none")
+			return Pipeline<>();
+		if (name == "damped")
+			return Pipeline<Damping>();
+		if (name == "air")
+			return Pipeline<Damping, Drag>();
+		if (name == "driven")
+			return Pipeline<DrivenPivot, Damping>();
+		if (name == "driven-air")
+			return Pipeline<DrivenPivot, Damping, Drag>();
+		throw std::runtime_error("forces: unknown preset " + name);
+	}
+
+	// accel(dt) of terms for Pendulum::Step and Derivative in a step from time t
+	template<typename T = double, typename P>
+	auto Accel(P const& terms, double t) noexcept
+	{
+		return [&terms, t](double dt) {
+			return [bound = terms.At(T(t + dt))](std::size_t i, mth::vec<T> const& x, mth::vec<T> const& v, T m) {
+				return bound(Ball<T>{i, x, v, m});
+			};
+		};
+	}
+
+	// one step of pend from time t under terms, a Pipeline or a Preset
+	template<typename P, typename S = RungeKuttaSolver, typename T>
+	void Step(BasicPendulum<T>& pend, P const& terms, double t, double h, S const& solver = S())
+	{
+		if constexpr (requires { std::variant_size<P>::value; })
+			std::visit([&](auto const& p) { Step(pend, p, t, h, solver); }, terms);
+		else if constexpr (std::is_same_v<P, Pipeline<>>)
+			pend.Step(h, solver);
+		else
+			pend.Step(h, solver, Accel<T>(terms, t));
+	}
+} // namespace forces
@@ -0,0 +1,373 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+/*
+ * Asynchronous simulation jobs as C++20 coroutines on a shared executor.
+ * A job is a coroutine that steps its own pendulum for one time quantum, then
+ * goes to the back of the executor queue, so any number of jobs with any step
+ * rates share the executor threads round robin by CPU time, without a thread per job.
+ *
+ *   jobs::Executor ex;
+ *   auto job = jobs::Simulate(ex, pend, {.duration = 10, .step = 1e-3, .reportEvery = 100});
+ *   while (auto s = co_await job.Next()) ...   // partial trajectory
+ *   auto const& res = co_await job;            // or job.Wait() outside coroutines
+ *
+ * Jobs stop on completion, Cancel(), a stop token or a deadline;
+ * the result keeps the state reached in every case.
+ */
+namespace jobs
+{
+	class Executor
+	{
+	private:
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<std::coroutine_handle<>> queue;
+		std::stop_source stopping;
+		std::vector<std::thread> threads;
+
+		void Work()
+		{
+			for (;;)
+			{
+				std::coroutine_handle<> h;
+				{
+					std::unique_lock lock(mutex);
+					wake.wait(lock, [&] { return stopping.stop_requested() || !queue.empty(); });
+					if (queue.empty())
+						return;
+					h = queue.front();
+					queue.pop_front();
+				}
+				h.resume();
+			}
+		}
+
+	public:
+		explicit Executor(unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+		{
+			for (unsigned i = 0; i < threads; i++)
+				this->threads.emplace_back([this] { Work(); });
+		}
+		// running jobs end as cancelled, everything they wake still runs before the threads exit
+		~Executor()
+		{
+			{
+				std::lock_guard lock(mutex);
+				stopping.request_stop();
+			}
+			wake.notify_all();
+			for (auto& t : threads)
+				t.join();
+		}
+		Executor(Executor const&) = delete;
+		Executor& operator=(Executor const&) = delete;
+
+		std::stop_token Stopping() const noexcept { return stopping.get_token(); }
+
+		void Post(std::coroutine_handle<> h)
+		{
+			{
+				std::lock_guard lock(mutex);
+				queue.push_back(h);
+			}
+			wake.notify_one();
+		}
+
+		// co_await ex.Schedule() continues on an executor thread, behind everything queued
+		auto Schedule() noexcept
+		{
+			struct Awaiter
+			{
+				Executor& ex;
+				bool await_ready() const noexcept { return false; }
+				void await_suspend(std::coroutine_handle<> h) { ex.Post(h); }
+				void await_resume() const noexcept {}
+			};
+			return Awaiter{*this};
+		}
+	};
+
+	enum class Status
+	{
+		Running,
+		Completed,
+		Cancelled,
+		Expired,
+		Failed,
+	};
+
+	struct Options
+	{
+		double duration = 1;
+		// rounded down so whole steps fit the duration
+		double step = 1.0 / 240;
+		Method solver = Method::RungeKutta;
+		// steps between samples, 0 for none
+		std::size_t reportEvery = 0;
+		// samples carry the whole state, otherwise only time and energy
+		bool fullState = true;
+		// samples held until read; when full the oldest is dropped and counted, the job never waits
+		std::size_t maxSamples = 256;
+		// executor time a job gets before yielding to others
+		std::chrono::microseconds quantum{200};
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		std::stop_token stop;
+	};
+
+	struct Sample
+	{
+		double time;
+		std::size_t steps;
+		double energy;
+		std::valarray<vec> state;
+	};
+
+	struct Result
+	{
+		Status status = Status::Running;
+		Pendulum pend;
+		double time = 0;
+		std::size_t steps = 0;
+		std::exception_ptr error;
+	};
+
+	namespace detail
+	{
+		struct State
+		{
+			Executor& ex;
+			std::mutex mutex;
+			std::condition_variable done;
+			std::deque<Sample> samples;
+			std::size_t maxSamples = 256, dropped = 0;
+			std::coroutine_handle<> reader;
+			std::vector<std::coroutine_handle<>> waiters;
+			std::stop_source cancel;
+			Result result;
+
+			explicit State(Executor& ex)
+			: ex(ex)
+			{}
+
+			void Push(Sample s)
+			{
+				std::coroutine_handle<> r;
+				{
+					std::lock_guard lock(mutex);
+					if (samples.size() >= maxSamples)
+					{
+						samples.pop_front();
+						dropped++;
+					}
+					samples.push_back(std::move(s));
+					r = std::exchange(reader, nullptr);
+				}
+				if (r)
+					ex.Post(r);
+			}
+
+			void Finish(Status status, Pendulum&& pend, double time, std::size_t steps, std::exception_ptr error = nullptr)
+			{
+				std::coroutine_handle<> r;
+				std::vector<std::coroutine_handle<>> w;
+				{
+					std::lock_guard lock(mutex);
+					if (result.status != Status::Running)
+						return;
+					result = {status, std::move(pend), time, steps, error};
+					r = std::exchange(reader, nullptr);
+					w.swap(waiters);
+				}
+				done.notify_all();
+				if (r)
+					ex.Post(r);
+				for (auto h : w)
+					ex.Post(h);
+			}
+		};
+
+		// fire and forget coroutine, owns itself
+		struct Detached
+		{
+			struct promise_type
+			{
+				Detached get_return_object() noexcept { return {}; }
+				std::suspend_never initial_suspend() noexcept { return {}; }
+				std::suspend_never final_suspend() noexcept { return {}; }
+				void return_void() noexcept {}
+				void unhandled_exception() noexcept { std::terminate(); }
+			};
+		};
+
+		inline Detached Run(std::shared_ptr<State> st, Pendulum pend, Options opt)
+		{
+			co_await st->ex.Schedule();
+			using Clock = std::chrono::steady_clock;
+			auto n = static_cast<std::size_t>(std::ceil(opt.duration / opt.step - 1e-9));
+			auto h = n ? opt.duration / n : 0;
+			std::size_t steps = 0;
+			auto status = Status::Completed;
+			std::exception_ptr error;
+			try
+			{
+				auto solver = Solver(opt.solver);
+				auto cancel = st->cancel.get_token();
+				auto shutdown = st->ex.Stopping();
+				for (bool more = true; more;)
+				{
+					auto end = Clock::now() + opt.quantum;
+					for (;;)
+					{
+						if (steps == n)
+						{
+							more = false;
+							break;
+						}
+						if (cancel.stop_requested() || opt.stop.stop_requested() || shutdown.stop_requested())
+						{
+							status = Status::Cancelled;
+							more = false;
+							break;
+						}
+						auto now = Clock::now();
+						if (now >= opt.deadline)
+						{
+							status = Status::Expired;
+							more = false;
+							break;
+						}
+						if (now >= end)
+							break;
+						std::visit([&](auto const& s) { pend.Step(h, s); }, solver);
+						steps++;
+						if (opt.reportEvery && steps % opt.reportEvery == 0)
+							st->Push({steps * h, steps, pend.ballParams.empty() ? 0 : pend.Energy(pend.ballCoords),
+									opt.fullState ? pend.ballCoords : std::valarray<vec>()});
+					}
+					if (more)
+						co_await st->ex.Schedule();
+				}
+			}
+			catch (...)
+			{
+				status = Status::Failed;
+				error = std::current_exception();
+			}
+			st->Finish(status, std::move(pend), steps * h, steps, error);
+		}
+	} // namespace detail
+
+	// handle of a running simulation, single reader of samples, any number of waiters
+	class Job
+	{
+	private:
+		std::shared_ptr<detail::State> st;
+
+	public:
+		explicit Job(std::shared_ptr<detail::State> st)
+		: st(std::move(st))
+		{}
+
+		void Cancel() noexcept { st->cancel.request_stop(); }
+		jobs::Status Status() const
+		{
+			std::lock_guard lock(st->mutex);
+			return st->result.status;
+		}
+		// samples lost to a reader slower than the job, see Options::maxSamples
+		std::size_t Dropped() const
+		{
+			std::lock_guard lock(st->mutex);
+			return st->dropped;
+		}
+
+		// next sample, nullopt once the job has finished and all samples were read
+		auto Next()
+		{
+			struct Awaiter
+			{
+				detail::State& st;
+				bool Available() const noexcept { return !st.samples.empty() || st.result.status != jobs::Status::Running; }
+				bool await_ready()
+				{
+					std::lock_guard lock(st.mutex);
+					return Available();
+				}
+				bool await_suspend(std::coroutine_handle<> h)
+				{
+					std::lock_guard lock(st.mutex);
+					if (Available())
+						return false;
+					st.reader = h;
+					return true;
+				}
+				std::optional<Sample> await_resume()
+				{
+					std::lock_guard lock(st.mutex);
+					if (st.samples.empty())
+						return std::nullopt;
+					auto s = std::move(st.samples.front());
+					st.samples.pop_front();
+					return s;
+				}
+			};
+			return Awaiter{*st};
+		}
+
+		// co_await job: final result, resumes on the executor
+		auto operator co_await() const
+		{
+			struct Awaiter
+			{
+				detail::State& st;
+				bool await_ready()
+				{
+					std::lock_guard lock(st.mutex);
+					return st.result.status != jobs::Status::Running;
+				}
+				bool await_suspend(std::coroutine_handle<> h)
+				{
+					std::lock_guard lock(st.mutex);
+					if (st.result.status != jobs::Status::Running)
+						return false;
+					st.waiters.push_back(h);
+					return true;
+				}
+				Result const& await_resume() const noexcept { return st.result; }
+			};
+			return Awaiter{*st};
+		}
+
+		// blocking, for callers outside coroutines
+		Result const& Wait() const
+		{
+			std::unique_lock lock(st->mutex);
+			st->done.wait(lock, [&] { return st->result.status != jobs::Status::Running; });
+			return st->result;
+		}
+	};
+
+	inline Job Simulate(Executor& ex, Pendulum pend, Options opt)
+	{
+		auto st = std::make_shared<detail::State>(ex);
+		st->maxSamples = std::max<std::size_t>(1, opt.maxSamples);
+		detail::Run(st, std::move(pend), std::move(opt));
+		return Job(std::move(st));
+	}
+} // namespace jobs
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <cmath>
+#include <vector>
+
+/*
+ * Lyapunov spectrum through the variational equations.
+ * Tangent vectors are appended to the state, so every solver stage advances
+ * them together with the trajectory and link geometry is computed once per stage
+ * for all of them. Tangents are re-orthonormalized (modified Gram-Schmidt)
+ * every `orthoEvery` steps and growth logarithms are accumulated.
+ *
+ * The trajectory itself is stepped by Pendulum::Derivative, only its Jacobian is here.
+ * Parameters are copied in, Pend() is the trajectory so far.
+ *
+ * Tangent t occupies [n * (t + 1), n * (t + 2)) of the state, n = 2 * balls,
+ * in the same {x, v} layout as Pendulum::ballCoords.
+ */
+class Lyapunov
+{
+private:
+	// parameters and the trajectory, state[0, n) after every step
+	Pendulum pend;
+	std::size_t count;
+	std::valarray<vec> state;
+	std::vector<double> logSum;
+	double time = 0, measured = 0;
+	std::size_t steps = 0;
+	// trajectory part of a stage and its derivative, for Pendulum::Derivative
+	mutable std::valarray<vec> head, headDerivative;
+
+	std::size_t Size() const noexcept { return pend.ballCoords.size(); }
+
+	std::valarray<vec> Derivative(std::valarray<vec> const& p, double delta) const
+	{
+		auto const& par = pend.ballParams;
+		auto balls = par.size();
+		auto n = Size();
+		auto ret = std::valarray<vec>(p.size());
+
+		head.resize(n);
+		headDerivative.resize(n);
+		for (std::size_t i = 0; i < n; i++)
+			head[i] = p[i];
+		pend.Derivative(head, delta, headDerivative);
+		for (std::size_t i = 0; i < n; i++)
+			ret[i] = headDerivative[i];
+
+		// link j joins ball j - 1 (or the pivot) and ball j
+		// force on ball j from it is -f * d, its derivative by d is J = k ((1 - r / L) I + r / L dd^T)
+		auto link = [&](std::size_t j, vec& dir, double& a, double& b) {
+					auto d = j == 0 ? p[0] : p[j * 2] - p[j * 2 - 2];
+					auto len = d.Len();
+					dir = d / len;
+					auto k = pend.LinkStiffness(j);
+					auto rl = pend.LinkLength(j) / len;
+					a = (1 - rl) * k;
+					b = k * rl;
+				};
+
+		vec dirp;
+		double ap, bp;
+		link(0, dirp, ap, bp);
+		for (std::size_t j = 0; j < balls; j++)
+		{
+			vec dirn = vec(0);
+			double an = 0, bn = 0;
+			if (j + 1 < balls)
+				link(j + 1, dirn, an, bn);
+			auto m = par[j].m;
+			for (std::size_t t = 1; t <= count; t++)
+			{
+				auto base = t * n;
+				auto const& dx = p[base + j * 2];
+				auto ddp = j == 0 ? dx : dx - p[base + j * 2 - 2];
+				auto force = -(ddp * ap + dirp * (bp * (dirp & ddp)));
+				if (j + 1 < balls)
+				{
+					auto ddn = p[base + j * 2 + 2] - dx;
+					force += ddn * an + dirn * (bn * (dirn & ddn));
+				}
+				ret[base + j * 2] = p[base + j * 2 + 1];
+				ret[base + j * 2 + 1] = force / m;
+			}
+			dirp = dirn;
+			ap = an;
+			bp = bn;
+		}
+		return ret;
+	}
+
+	double Dot(std::size_t a, std::size_t b) const noexcept
+	{
+		auto n = Size();
+		double s = 0;
+		for (std::size_t i = 0; i < n; i++)
+			s += state[a * n + i] & state[b * n + i];
+		return s;
+	}
+
+	void Orthonormalize(bool accumulate)
+	{
+		auto n = Size();
+		for (std::size_t t = 1; t <= count; t++)
+		{
+			for (std::size_t u = 1; u < t; u++)
+			{
+				auto proj = Dot(t, u);
+				for (std::size_t i = 0; i < n; i++)
+					state[t * n + i] -= state[u * n + i] * proj;
+			}
+			auto len = std::sqrt(Dot(t, t));
+			if (accumulate)
+				logSum[t - 1] += std::log(len);
+			for (std::size_t i = 0; i < n; i++)
+				state[t * n + i] /= len;
+		}
+	}
+
+public:
+	std::size_t const orthoEvery;
+
+	// count == 0 means full spectrum, 6 per ball
+	explicit Lyapunov(Pendulum const& pend, std::size_t count = 0, std::size_t orthoEvery = 10)
+	: pend(pend)
+	, count(count == 0 ? pend.ballCoords.size() * 3 : std::min(count, pend.ballCoords.size() * 3))
+	, logSum(this->count, 0)
+	, orthoEvery(orthoEvery)
+	{
+		auto n = Size();
+		state.resize(n * (this->count + 1), vec(0));
+		for (std::size_t i = 0; i < n; i++)
+			state[i] = pend.ballCoords[i];
+		// generic start directions, Gram-Schmidt makes them a basis
+		for (std::size_t i = n; i < state.size(); i++)
+			state[i] = vec(mth::Rnd1(), mth::Rnd1(), mth::Rnd1());
+		Orthonormalize(false);
+	}
+
+	// advances the trajectory together with the tangents
+	template<typename S = RungeKuttaSolver>
+	void Step(double delta, S const& solver = S())
+	{
+		if (pend.ballParams.empty())
+			return;
+		state += solver([this](auto const& p, double d) { return Derivative(p, d); }, state, delta);
+		for (std::size_t i = 0; i < Size(); i++)
+			pend.ballCoords[i] = state[i];
+		time += delta;
+		if (++steps % orthoEvery == 0)
+		{
+			Orthonormalize(true);
+			measured = time;
+		}
+	}
+
+	Pendulum const& Pend() const noexcept { return pend; }
+
+	// per unit of simulated time, converge to descending order
+	std::vector<double> Exponents() const
+	{
+		auto res = logSum;
+		for (auto& l : res)
+			l = measured > 0 ? l / measured : 0;
+		return res;
+	}
+};
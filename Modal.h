@@ -0,0 +1,318 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace modal
+{
+	/*
+	 * Eigen decomposition of symmetric tridiagonal matrix (implicit QL).
+	 * d -- diagonal, becomes eigenvalues
+	 * e -- e[i] couples i and i + 1, destroyed
+	 * z -- n x n row major, becomes eigenvectors in columns
+	 */
+	inline void TridiagonalEigen(std::vector<double>& d, std::vector<double>& e, std::vector<double>& z)
+	{
+		auto n = d.size();
+		z.assign(n * n, 0);
+		for (std::size_t i = 0; i < n; i++)
+			z[i * n + i] = 1;
+		e.resize(n);
+		if (n != 0)
+			e[n - 1] = 0;
+		for (std::size_t l = 0; l < n; l++)
+		{
+			for (int iter = 0;; iter++)
+			{
+				auto m = l;
+				for (; m + 1 < n; m++)
+				{
+					auto dd = std::abs(d[m]) + std::abs(d[m + 1]);
+					if (std::abs(e[m]) <= std::numeric_limits<double>::epsilon() * dd)
+						break;
+				}
+				if (m == l)
+					break;
+				if (iter == 60)
+					throw std::runtime_error("modal: eigen decomposition did not converge");
+				auto g = (d[l + 1] - d[l]) / (2 * e[l]);
+				auto r = std::hypot(g, 1.0);
+				g = d[m] - d[l] + e[l] / (g + std::copysign(r, g));
+				double s = 1, c = 1, p = 0;
+				bool underflow = false;
+				for (auto i = m; i-- > l;)
+				{
+					auto f = s * e[i];
+					auto b = c * e[i];
+					e[i + 1] = r = std::hypot(f, g);
+					if (r == 0)
+					{
+						d[i + 1] -= p;
+						e[m] = 0;
+						underflow = true;
+						break;
+					}
+					s = f / r;
+					c = g / r;
+					g = d[i + 1] - p;
+					r = (d[i] - g) * s + 2 * c * b;
+					p = s * r;
+					d[i + 1] = g + p;
+					g = c * r - b;
+					for (std::size_t k = 0; k < n; k++)
+					{
+						f = z[k * n + i + 1];
+						z[k * n + i + 1] = s * z[k * n + i] + c * f;
+						z[k * n + i] = c * z[k * n + i] - s * f;
+					}
+				}
+				if (underflow)
+					continue;
+				d[l] -= p;
+				e[l] = g;
+				e[m] = 0;
+			}
+		}
+	}
+
+	// normal modes of M u'' = -K u with tridiagonal K
+	struct Modes
+	{
+		std::size_t n = 0;
+		std::vector<double> omega;
+		// shape[j * n + k] -- component j of mass-normalized mode k
+		std::vector<double> shape;
+
+		// link j joins ball j - 1 (or the pivot) and ball j
+		void Build(std::vector<double> const& linkStiffness, std::vector<double> const& sqrtMass)
+		{
+			n = sqrtMass.size();
+			std::vector<double> d(n), e(n, 0);
+			for (std::size_t j = 0; j < n; j++)
+			{
+				auto below = j + 1 < n ? linkStiffness[j + 1] : 0;
+				d[j] = (linkStiffness[j] + below) / (sqrtMass[j] * sqrtMass[j]);
+				if (j + 1 < n)
+					e[j] = -below / (sqrtMass[j] * sqrtMass[j + 1]);
+			}
+			TridiagonalEigen(d, e, shape);
+			omega.resize(n);
+			for (std::size_t k = 0; k < n; k++)
+				omega[k] = std::sqrt(std::max(d[k], 0.0));
+		}
+	};
+} // namespace modal
+
+/*
+ * Small oscillation fast path. Around the hanging equilibrium the chain is linear:
+ * motion along g and the two directions across it decouple into tridiagonal
+ * problems whose normal modes are computed once per configuration.
+ * While the chain stays close to equilibrium state is evaluated analytically,
+ * O(N^2) per step and exact for any h; once a link turns by more than
+ * `tolerance` radians (scaled by its relative tension change) stepping falls back to the solver.
+ */
+class ModalStepper
+{
+private:
+	std::vector<Pendulum::BallData> params;
+	vec g = vec(0);
+	bool valid = false;
+
+	modal::Modes axial, transverse;
+	// along g, two across it
+	vec axis[3];
+	std::vector<vec> rest;
+	std::vector<double> sqrtMass, length, tension, stiffness;
+
+	bool active = false;
+	double time = 0;
+	std::vector<double> q0[3], dq0[3];
+	// last state written to the pendulum, anything else means it was edited
+	std::valarray<vec> written, next;
+
+	modal::Modes const& ModesOf(int c) const noexcept { return c == 0 ? axial : transverse; }
+
+	bool Prepare(Pendulum const& pend)
+	{
+		auto same = pend.g == g && pend.ballParams.size() == params.size();
+		for (std::size_t i = 0; same && i < params.size(); i++)
+		{
+			auto const& a = pend.ballParams[i];
+			auto const& b = params[i];
+			same = a.r == b.r && a.m == b.m && a.k == b.k;
+		}
+		if (same)
+			return valid;
+
+		params = pend.ballParams;
+		g = pend.g;
+		active = false;
+		auto n = params.size();
+		auto gl = g.Len();
+		valid = n != 0 && gl > 0;
+		if (!valid)
+			return false;
+
+		axis[0] = g / gl;
+		axis[1] = (axis[0] % (std::abs(axis[0].X) < 0.9 ? vec(1, 0, 0) : vec(0, 1, 0))).Normalize();
+		axis[2] = axis[0] % axis[1];
+
+		sqrtMass.resize(n);
+		length.resize(n);
+		tension.resize(n);
+		stiffness.resize(n);
+		rest.resize(n);
+		double below = 0;
+		for (std::size_t j = n; j-- > 0;)
+		{
+			below += params[j].m;
+			tension[j] = below * gl;
+			sqrtMass[j] = std::sqrt(params[j].m);
+			stiffness[j] = pend.LinkStiffness(j);
+		}
+		std::vector<double> lateral(n);
+		vec x = vec(0);
+		for (std::size_t j = 0; j < n; j++)
+		{
+			length[j] = pend.LinkLength(j) + tension[j] / stiffness[j];
+			lateral[j] = tension[j] / length[j];
+			x += axis[0] * length[j];
+			rest[j] = x;
+		}
+		axial.Build(stiffness, sqrtMass);
+		transverse.Build(lateral, sqrtMass);
+		return true;
+	}
+
+	// how far from the linear regime coords are, compared against tolerance
+	double Deviation(std::valarray<vec> const& coords) const
+	{
+		double worst = 0;
+		vec xp = vec(0);
+		for (std::size_t j = 0; j < rest.size(); j++)
+		{
+			auto d = coords[j * 2] - xp;
+			xp = coords[j * 2];
+			auto along = d & axis[0];
+			auto across = (d - axis[0] * along).Len() / length[j];
+			// motion along a link is exactly linear, errors come from turning it
+			// and from the tension change turning it couples with
+			auto dt = std::abs(stiffness[j] * (d.Len() - length[j]));
+			worst = std::max(worst, across * (1 + dt / tension[j]));
+		}
+		return worst;
+	}
+
+	static bool Same(std::valarray<vec> const& a, std::valarray<vec> const& b) noexcept
+	{
+		if (a.size() != b.size())
+			return false;
+		for (std::size_t i = 0; i < a.size(); i++)
+			if (a[i] != b[i])
+				return false;
+		return true;
+	}
+
+	void Enter(std::valarray<vec> const& coords)
+	{
+		auto n = rest.size();
+		for (int c = 0; c < 3; c++)
+		{
+			auto const& md = ModesOf(c);
+			q0[c].assign(n, 0);
+			dq0[c].assign(n, 0);
+			for (std::size_t j = 0; j < n; j++)
+			{
+				auto u = ((coords[j * 2] - rest[j]) & axis[c]) * sqrtMass[j];
+				auto du = (coords[j * 2 + 1] & axis[c]) * sqrtMass[j];
+				for (std::size_t k = 0; k < n; k++)
+				{
+					q0[c][k] += md.shape[j * n + k] * u;
+					dq0[c][k] += md.shape[j * n + k] * du;
+				}
+			}
+		}
+		time = 0;
+		active = true;
+	}
+
+	void Evaluate(double t, std::valarray<vec>& coords) const
+	{
+		auto n = rest.size();
+		coords.resize(n * 2);
+		for (std::size_t j = 0; j < n; j++)
+		{
+			coords[j * 2] = rest[j];
+			coords[j * 2 + 1] = vec(0);
+		}
+		std::vector<double> q(n), dq(n);
+		for (int c = 0; c < 3; c++)
+		{
+			auto const& md = ModesOf(c);
+			for (std::size_t k = 0; k < n; k++)
+			{
+				auto w = md.omega[k];
+				if (w == 0)
+				{
+					q[k] = q0[c][k] + dq0[c][k] * t;
+					dq[k] = dq0[c][k];
+					continue;
+				}
+				auto cs = std::cos(w * t), sn = std::sin(w * t);
+				q[k] = q0[c][k] * cs + dq0[c][k] / w * sn;
+				dq[k] = dq0[c][k] * cs - q0[c][k] * w * sn;
+			}
+			for (std::size_t j = 0; j < n; j++)
+			{
+				double u = 0, du = 0;
+				for (std::size_t k = 0; k < n; k++)
+				{
+					u += md.shape[j * n + k] * q[k];
+					du += md.shape[j * n + k] * dq[k];
+				}
+				coords[j * 2] += axis[c] * (u / sqrtMass[j]);
+				coords[j * 2 + 1] += axis[c] * (du / sqrtMass[j]);
+			}
+		}
+	}
+
+public:
+	double tolerance = 0.02;
+
+	bool Active() const noexcept { return active; }
+	// angular frequencies along g and across it, empty until first Step
+	std::vector<double> const& AxialFrequencies() const noexcept { return axial.omega; }
+	std::vector<double> const& TransverseFrequencies() const noexcept { return transverse.omega; }
+
+	template<typename S = RungeKuttaSolver>
+	void Step(Pendulum& pend, double delta, S const& solver = S())
+	{
+		if (!Prepare(pend))
+		{
+			pend.Step(delta, solver);
+			return;
+		}
+		// half tolerance to get in, so the border is not crossed back and forth every step
+		if (active && !Same(pend.ballCoords, written))
+			active = false;
+		if (!active && Deviation(pend.ballCoords) < tolerance / 2)
+			Enter(pend.ballCoords);
+		if (active)
+		{
+			Evaluate(time + delta, next);
+			if (Deviation(next) <= tolerance)
+			{
+				time += delta;
+				pend.ballCoords = next;
+				std::swap(written, next);
+				return;
+			}
+			active = false;
+		}
+		pend.Step(delta, solver);
+	}
+};
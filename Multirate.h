@@ -0,0 +1,196 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <cmath>
+#include <vector>
+
+/*
+ * Multirate RK4: balls on stiff links take several micro steps per macro step.
+ * Balls are split by local frequency sqrt((k above + k below) / m);
+ * those with omega * h over `safeOmegaH` form the fast partition.
+ * Each macro step goes slowest first: slow balls take one RK4 step with fast
+ * neighbours extrapolated by their start velocity and acceleration, then fast
+ * balls take `ratio` RK4 micro steps with slow neighbours on the cubic Hermite
+ * curve between their two ends.
+ * Every acceleration touches only the ball and its two neighbours, so
+ * a micro step costs O(fast balls), not O(N).
+ */
+class MultirateStepper
+{
+private:
+	std::vector<Pendulum::BallData> params;
+	double macro = 0;
+	std::vector<std::size_t> fast, slow;
+	std::vector<double> omega;
+	std::size_t ratio = 1;
+
+	// state of one partition
+	struct Lane
+	{
+		std::vector<vec> x, v, kx[4], kv[4];
+	};
+	Lane fastLane, slowLane;
+	// position of every ball at stage time, meaningful for the partition and its neighbours
+	std::vector<vec> at;
+	std::vector<vec> x0, v0, a0;
+	std::vector<char> isFast;
+
+	void Prepare(Pendulum const& pend, double h)
+	{
+		bool same = h == macro && pend.ballParams.size() == params.size();
+		for (std::size_t i = 0; same && i < params.size(); i++)
+			same = pend.ballParams[i].k == params[i].k && pend.ballParams[i].m == params[i].m;
+		if (same)
+			return;
+		params = pend.ballParams;
+		macro = h;
+		auto n = params.size();
+		omega.resize(n);
+		isFast.assign(n, 0);
+		fast.clear();
+		slow.clear();
+		double fastest = 0;
+		for (std::size_t j = 0; j < n; j++)
+		{
+			auto k = pend.LinkStiffness(j) + (j + 1 < n ? pend.LinkStiffness(j + 1) : 0);
+			omega[j] = std::sqrt(k / params[j].m);
+			if (omega[j] * h > safeOmegaH)
+			{
+				isFast[j] = 1;
+				fast.push_back(j);
+				fastest = std::max(fastest, omega[j]);
+			}
+			else
+				slow.push_back(j);
+		}
+		ratio = std::min<std::size_t>(maxRatio, std::max<std::size_t>(1, std::ceil(fastest * h / safeOmegaH)));
+	}
+
+	vec Accel(Pendulum const& pend, std::size_t j) const
+	{
+		auto n = pend.ballParams.size();
+		auto a = pend.LinkForce(j, j == 0 ? at[0] : at[j] - at[j - 1]);
+		if (j + 1 < n)
+			a -= pend.LinkForce(j + 1, at[j + 1] - at[j]);
+		return a / pend.ballParams[j].m + pend.g;
+	}
+
+	/*
+	 * One RK4 step of balls in `idx`, others are given by outside(j, tau)
+	 * tau is time from the step start
+	 */
+	template<typename F>
+	void Advance(Pendulum const& pend, std::vector<std::size_t> const& idx, Lane& lane, double h, F const& outside)
+	{
+		auto n = idx.size();
+		auto stage = [&](int s, double tau, double w) {
+					// neighbours first, partition balls override
+					for (auto j : idx)
+					{
+						if (j > 0 && isFast[j - 1] != isFast[j])
+							at[j - 1] = outside(j - 1, tau);
+						if (j + 1 < at.size() && isFast[j + 1] != isFast[j])
+							at[j + 1] = outside(j + 1, tau);
+					}
+					for (std::size_t i = 0; i < n; i++)
+						at[idx[i]] = s == 0 ? lane.x[i] : lane.x[i] + lane.kx[s - 1][i] * w;
+					for (std::size_t i = 0; i < n; i++)
+					{
+						lane.kx[s][i] = s == 0 ? lane.v[i] : lane.v[i] + lane.kv[s - 1][i] * w;
+						lane.kv[s][i] = Accel(pend, idx[i]);
+					}
+				};
+		for (auto& k : lane.kx)
+			k.resize(n);
+		for (auto& k : lane.kv)
+			k.resize(n);
+		stage(0, 0, 0);
+		stage(1, h / 2, h / 2);
+		stage(2, h / 2, h / 2);
+		stage(3, h, h);
+		for (std::size_t i = 0; i < n; i++)
+		{
+			lane.x[i] += (lane.kx[0][i] + lane.kx[1][i] * 2 + lane.kx[2][i] * 2 + lane.kx[3][i]) * (h / 6);
+			lane.v[i] += (lane.kv[0][i] + lane.kv[1][i] * 2 + lane.kv[2][i] * 2 + lane.kv[3][i]) * (h / 6);
+		}
+	}
+
+	static void Load(Pendulum const& pend, std::vector<std::size_t> const& idx, Lane& lane)
+	{
+		lane.x.resize(idx.size());
+		lane.v.resize(idx.size());
+		for (std::size_t i = 0; i < idx.size(); i++)
+		{
+			lane.x[i] = pend.ballCoords[idx[i] * 2];
+			lane.v[i] = pend.ballCoords[idx[i] * 2 + 1];
+		}
+	}
+
+	static void Store(Pendulum& pend, std::vector<std::size_t> const& idx, Lane const& lane)
+	{
+		for (std::size_t i = 0; i < idx.size(); i++)
+		{
+			pend.ballCoords[idx[i] * 2] = lane.x[i];
+			pend.ballCoords[idx[i] * 2 + 1] = lane.v[i];
+		}
+	}
+
+public:
+	// omega * h that a single RK4 step is trusted with
+	double safeOmegaH = 0.3;
+	std::size_t maxRatio = 256;
+
+	std::vector<std::size_t> const& Fast() const noexcept { return fast; }
+	std::size_t Ratio() const noexcept { return ratio; }
+
+	void Step(Pendulum& pend, double h)
+	{
+		auto n = pend.ballParams.size();
+		if (n == 0)
+			return;
+		Prepare(pend, h);
+		if (fast.empty() || slow.empty())
+		{
+			for (std::size_t i = 0; i < ratio; i++)
+				pend.Step(h / ratio);
+			return;
+		}
+		at.resize(n);
+		x0.resize(n);
+		v0.resize(n);
+		for (std::size_t j = 0; j < n; j++)
+		{
+			x0[j] = pend.ballCoords[j * 2];
+			v0[j] = pend.ballCoords[j * 2 + 1];
+		}
+
+		// fast balls next to slow ones are extrapolated from their start
+		a0.resize(n);
+		for (std::size_t j = 0; j < n; j++)
+			at[j] = x0[j];
+		for (auto j : fast)
+			a0[j] = Accel(pend, j);
+
+		Load(pend, slow, slowLane);
+		Advance(pend, slow, slowLane, h, [&](std::size_t j, double tau) { return x0[j] + v0[j] * tau + a0[j] * (tau * tau / 2); });
+		Store(pend, slow, slowLane);
+
+		// slow ends are known now, follow them on a Hermite curve
+		auto micro = h / ratio;
+		Load(pend, fast, fastLane);
+		for (std::size_t m = 0; m < ratio; m++)
+		{
+			auto base = m * micro;
+			Advance(pend, fast, fastLane, micro, [&](std::size_t j, double tau) {
+						auto s = (base + tau) / h;
+						auto s2 = s * s, s3 = s2 * s;
+						auto const& x1 = pend.ballCoords[j * 2];
+						auto const& v1 = pend.ballCoords[j * 2 + 1];
+						return x0[j] * (2 * s3 - 3 * s2 + 1) + v0[j] * ((s3 - 2 * s2 + s) * h)
+							+ x1 * (-2 * s3 + 3 * s2) + v1 * ((s3 - s2) * h);
+					});
+		}
+		Store(pend, fast, fastLane);
+	}
+};
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <png.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * Headless rendering for batch export.
+ * Context draws into a framebuffer object of a windowless EGL context, preferring
+ * Mesa's surfaceless platform, so it runs on the software rasterizer without a display.
+ * Readback reads frame n into one pixel pack buffer while frame n - 1, read a frame
+ * earlier, is mapped from the other, so glReadPixels never waits for the copy.
+ * Writer encodes and writes frames on its own threads from a fixed pool of buffers,
+ * the renderer only blocks when the writers fall behind.
+ *
+ * Needs GL_GLEXT_PROTOTYPES for the GL 2.0+ entry points.
+ */
+namespace offscreen
+{
+	class Context
+	{
+	private:
+		EGLDisplay display = EGL_NO_DISPLAY;
+		EGLContext context = EGL_NO_CONTEXT;
+		GLuint fbo = 0, color = 0, depth = 0;
+		int width, height;
+
+		void Release() noexcept
+		{
+			if (context != EGL_NO_CONTEXT)
+			{
+				if (fbo)
+				{
+					glDeleteFramebuffers(1, &fbo);
+					glDeleteRenderbuffers(1, &color);
+					glDeleteRenderbuffers(1, &depth);
+				}
+				eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+				eglDestroyContext(display, context);
+			}
+			if (display != EGL_NO_DISPLAY)
+				eglTerminate(display);
+			context = EGL_NO_CONTEXT;
+			display = EGL_NO_DISPLAY;
+		}
+
+		[[noreturn]] void Fail(std::string const& what)
+		{
+			auto error = eglGetError();
+			Release();
+			char code[16];
+			std::snprintf(code, sizeof(code), "0x%04x", error);
+			throw std::runtime_error("offscreen: " + what + " (EGL error " + code + ")");
+		}
+
+	public:
+		Context(int width, int height)
+		: width(width), height(height)
+		{
+			char const* clientExt = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+			auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+			if (getPlatformDisplay && clientExt && std::strstr(clientExt, "EGL_MESA_platform_surfaceless"))
+				display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+			{
+				display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+				if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+					Fail("no EGL display");
+			}
+			if (!eglBindAPI(EGL_OPENGL_API))
+				Fail("EGL has no desktop OpenGL");
+			// any surface type, nothing is drawn to an EGL surface
+			EGLint attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE};
+			EGLConfig config;
+			EGLint count = 0;
+			if (!eglChooseConfig(display, attribs, &config, 1, &count) || count == 0)
+				Fail("no OpenGL config");
+			context = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+			if (context == EGL_NO_CONTEXT)
+				Fail("cannot create context");
+			if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+				Fail("cannot make a surfaceless context current");
+
+			glGenFramebuffers(1, &fbo);
+			glGenRenderbuffers(1, &color);
+			glGenRenderbuffers(1, &depth);
+			glBindRenderbuffer(GL_RENDERBUFFER, color);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+			glBindRenderbuffer(GL_RENDERBUFFER, depth);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				Fail("framebuffer is incomplete");
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+		}
+		~Context() { Release(); }
+		Context(Context const&) = delete;
+		Context& operator=(Context const&) = delete;
+
+		int Width() const noexcept { return width; }
+		int Height() const noexcept { return height; }
+		// GL_RENDERER, e.g. llvmpipe for software rendering
+		std::string Renderer() const { return reinterpret_cast<char const*>(glGetString(GL_RENDERER)); }
+	};
+
+	// RGBA rows bottom-up, as glReadPixels returns them
+	class Readback
+	{
+	private:
+		GLuint pbo[2] = {};
+		int width, height;
+		std::size_t bytes;
+		std::uint64_t issued = 0;
+		bool pending = false;
+
+		template<typename F>
+		void Map(int i, std::uint64_t frame, F& sink)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+			auto pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+			if (!pixels)
+				throw std::runtime_error("offscreen: cannot map pixel buffer");
+			sink(static_cast<unsigned char const*>(pixels), frame);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+
+	public:
+		Readback(int width, int height)
+		: width(width), height(height), bytes(std::size_t(width) * height * 4)
+		{
+			glGenBuffers(2, pbo);
+			for (auto b : pbo)
+			{
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, b);
+				glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		}
+		~Readback() { glDeleteBuffers(2, pbo); }
+		Readback(Readback const&) = delete;
+		Readback& operator=(Readback const&) = delete;
+
+		std::size_t Bytes() const noexcept { return bytes; }
+
+		// starts reading the current framebuffer, sink(pixels, frame) gets the previous frame
+		template<typename F>
+		void Read(F&& sink)
+		{
+			auto cur = static_cast<int>(issued % 2);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[cur]);
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			if (pending)
+				Map(1 - cur, issued - 1, sink);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			issued++;
+			pending = true;
+		}
+
+		// the last frame read, once rendering is over
+		template<typename F>
+		void Flush(F&& sink)
+		{
+			if (pending)
+				Map(static_cast<int>((issued - 1) % 2), issued - 1, sink);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			pending = false;
+		}
+	};
+
+	enum class Format
+	{
+		Png,
+		// RGBA frames top-down in one stream, e.g. for ffmpeg -f rawvideo -pix_fmt rgba
+		Raw,
+	};
+
+	class Writer
+	{
+	private:
+		struct Frame
+		{
+			std::uint64_t number;
+			std::vector<unsigned char> pixels;
+		};
+
+		Format format;
+		std::string path;
+		int width, height;
+		std::FILE* raw = nullptr;
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::vector<Frame> pool;
+		std::vector<std::size_t> idle;
+		std::deque<std::size_t> ready;
+		bool closing = false;
+		std::exception_ptr error;
+		std::vector<std::thread> threads;
+		double waited = 0;
+
+		void Write(Frame const& f)
+		{
+			auto stride = width * 4;
+			if (format == Format::Raw)
+			{
+				// GL rows are bottom-up
+				for (int y = height - 1; y >= 0; y--)
+					if (std::fwrite(f.pixels.data() + std::size_t(y) * stride, 1, stride, raw) != std::size_t(stride))
+						throw std::runtime_error("offscreen: cannot write " + path);
+				return;
+			}
+			char name[32];
+			std::snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(f.number));
+			png_image image = {};
+			image.version = PNG_IMAGE_VERSION;
+			image.width = width;
+			image.height = height;
+			image.format = PNG_FORMAT_RGBA;
+			// negative stride: bottom-up rows
+			if (!png_image_write_to_file(&image, (path + name).c_str(), 0, f.pixels.data(), -stride, nullptr))
+				throw std::runtime_error(std::string("offscreen: ") + image.message);
+		}
+
+		void Work()
+		{
+			for (;;)
+			{
+				std::size_t i;
+				{
+					std::unique_lock lock(mutex);
+					changed.wait(lock, [&] { return closing || !ready.empty(); });
+					if (ready.empty())
+						return;
+					i = ready.front();
+					ready.pop_front();
+				}
+				try
+				{
+					Write(pool[i]);
+				}
+				catch (...)
+				{
+					std::lock_guard lock(mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+				{
+					std::lock_guard lock(mutex);
+					idle.push_back(i);
+				}
+				changed.notify_all();
+			}
+		}
+
+	public:
+		// path is a directory for PNG, a file or "-" (stdout) for raw; raw is written by one thread to keep order
+		Writer(Format format, std::string path, int width, int height, unsigned threads = 1)
+		: format(format), path(std::move(path)), width(width), height(height)
+		{
+			if (format == Format::Raw)
+			{
+				threads = 1;
+				raw = this->path == "-" ? stdout : std::fopen(this->path.c_str(), "wb");
+				if (!raw)
+					throw std::runtime_error("offscreen: cannot write " + this->path);
+			}
+			threads = std::max(1u, threads);
+			// one frame in each writer, as many again queued
+			pool.resize(threads * 2 + 1);
+			for (std::size_t i = 0; i < pool.size(); i++)
+			{
+				pool[i].pixels.resize(std::size_t(width) * height * 4);
+				idle.push_back(i);
+			}
+			for (unsigned i = 0; i < threads; i++)
+				this->threads.emplace_back([this] { Work(); });
+		}
+		~Writer()
+		{
+			try
+			{
+				Close();
+			}
+			catch (...)
+			{
+			}
+		}
+		Writer(Writer const&) = delete;
+		Writer& operator=(Writer const&) = delete;
+
+		// copies the frame into a free buffer, waits for one if all are busy
+		void Push(unsigned char const* pixels, std::uint64_t number)
+		{
+			std::size_t i;
+			{
+				std::unique_lock lock(mutex);
+				if (error)
+					std::rethrow_exception(error);
+				if (idle.empty())
+				{
+					auto start = std::chrono::steady_clock::now();
+					changed.wait(lock, [&] { return !idle.empty(); });
+					waited += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				}
+				i = idle.back();
+				idle.pop_back();
+			}
+			pool[i].number = number;
+			std::memcpy(pool[i].pixels.data(), pixels, pool[i].pixels.size());
+			{
+				std::lock_guard lock(mutex);
+				ready.push_back(i);
+			}
+			changed.notify_all();
+		}
+
+		// waits for queued frames, rethrows the first write error
+		void Close()
+		{
+			{
+				std::lock_guard lock(mutex);
+				closing = true;
+			}
+			changed.notify_all();
+			for (auto& t : threads)
+				t.join();
+			threads.clear();
+			if (raw && raw != stdout)
+				std::fclose(raw);
+			else if (raw)
+				std::fflush(raw);
+			raw = nullptr;
+			if (error)
+				std::rethrow_exception(std::exchange(error, nullptr));
+		}
+
+		// seconds the renderer spent waiting for a free buffer
+		double Waited() const noexcept { return waited; }
+	};
+} // namespace offscreen
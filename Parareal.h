@@ -0,0 +1,119 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+/*
+ * Parareal parallel-in-time integration.
+ * The horizon is cut into slices; a cheap coarse propagator G gives a first guess
+ * of every slice start, then each iteration runs the fine propagator F on all
+ * unconverged slices concurrently and corrects serially:
+ *   U[n + 1] = G(U'[n]) + F(U[n]) - G(U[n])
+ * After k iterations the first k slices equal the serial fine solution exactly.
+ */
+template<typename C = RungeKuttaSolver, typename F = RungeKuttaSolver>
+class Parareal
+{
+public:
+	struct Report
+	{
+		std::size_t iterations = 0;
+		// max change of a slice start position in the last iteration
+		double defect = 0;
+		double seconds = 0;
+	};
+
+	std::size_t slices;
+	double coarseStep, fineStep;
+	std::size_t maxIterations = 0; // 0 means slices, which is always exact
+	double tolerance = 1e-9;
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	C coarse;
+	F fine;
+
+	Parareal(std::size_t slices, double coarseStep, double fineStep, C coarse = C(), F fine = F())
+	: slices(slices)
+	, coarseStep(coarseStep)
+	, fineStep(fineStep)
+	, coarse(coarse)
+	, fine(fine)
+	{}
+
+	// advances pend by duration with the same step as `step` would use
+	template<typename S>
+	static void Propagate(Pendulum& pend, double duration, double step, S const& solver)
+	{
+		auto n = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(duration / step - 1e-9)));
+		auto h = duration / n;
+		for (std::size_t i = 0; i < n; i++)
+			pend.Step(h, solver);
+	}
+
+	Report Run(Pendulum& pend, double duration) const
+	{
+		auto start = std::chrono::steady_clock::now();
+		Report rep;
+		if (pend.ballParams.empty() || slices == 0)
+			return rep;
+
+		auto slice = duration / slices;
+		auto iterations = maxIterations == 0 ? slices : std::min(maxIterations, slices);
+		std::vector<std::valarray<vec>> u(slices + 1), g(slices), f(slices);
+		Pendulum work = pend;
+		auto run = [&](Pendulum& p, std::valarray<vec> const& from, auto const& solver, double step, std::valarray<vec>& to) {
+					p.ballCoords = from;
+					Propagate(p, slice, step, solver);
+					to = p.ballCoords;
+				};
+
+		u[0] = pend.ballCoords;
+		for (std::size_t n = 0; n < slices; n++)
+		{
+			run(work, u[n], coarse, coarseStep, g[n]);
+			u[n + 1] = g[n];
+		}
+
+		for (std::size_t k = 0; k < iterations; k++)
+		{
+			// slices before k are already exact
+			std::atomic<std::size_t> next = k;
+			auto worker = [&]() {
+						Pendulum p = pend;
+						for (std::size_t n; (n = next++) < slices;)
+							run(p, u[n], fine, fineStep, f[n]);
+					};
+			std::vector<std::thread> pool;
+			for (unsigned t = 1; t < std::min<std::size_t>(threads, slices - k); t++)
+				pool.emplace_back(worker);
+			worker();
+			for (auto& t : pool)
+				t.join();
+
+			rep.defect = 0;
+			// the first corrected slice is the fine result itself
+			u[k + 1] = f[k];
+			for (std::size_t n = k + 1; n < slices; n++)
+			{
+				std::valarray<vec> gn;
+				run(work, u[n], coarse, coarseStep, gn);
+				std::valarray<vec> corrected = gn + f[n] - g[n];
+				for (std::size_t i = 0; i < corrected.size(); i += 2)
+					rep.defect = std::max<double>(rep.defect, (corrected[i] - u[n + 1][i]).Len());
+				g[n] = std::move(gn);
+				u[n + 1] = std::move(corrected);
+			}
+			rep.iterations = k + 1;
+			if (rep.defect <= tolerance)
+				break;
+		}
+
+		pend.ballCoords = u[slices];
+		rep.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return rep;
+	}
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <cmath>
+#include <vector>
+
+/*
+ * Velocity Verlet with RATTLE constraints for links marked as rods.
+ * Rods carry no spring force, their length is restored after the position update
+ * (SHAKE) and their stretching velocity removed after the velocity update,
+ * so stiff links no longer limit the step. Springs and rods can be mixed freely.
+ */
+class RattleStepper
+{
+private:
+	mutable std::vector<vec> acc, old;
+
+	// spring and gravity accelerations, rods excluded
+	static void Accelerations(Pendulum const& pend, std::vector<vec>& a)
+	{
+		auto const& par = pend.ballParams;
+		auto const& p = pend.ballCoords;
+		a.assign(par.size(), pend.g);
+		for (std::size_t j = 0; j < par.size(); j++)
+		{
+			if (par[j].rod)
+				continue;
+			auto d = j == 0 ? p[0] : p[j * 2] - p[j * 2 - 2];
+			auto f = pend.LinkForce(j, d);
+			a[j] += f / par[j].m;
+			if (j != 0)
+				a[j - 1] -= f / par[j - 1].m;
+		}
+	}
+
+	// pivot does not move
+	static double InvMass(Pendulum const& pend, std::size_t j, bool upper) noexcept
+	{
+		if (upper)
+			return j == 0 ? 0 : 1 / pend.ballParams[j - 1].m;
+		return 1 / pend.ballParams[j].m;
+	}
+
+public:
+	// relative length error and stretching velocity accepted
+	double tolerance = 1e-10;
+	int maxIterations = 500;
+
+	void Step(Pendulum& pend, double h) const
+	{
+		auto const& par = pend.ballParams;
+		auto& p = pend.ballCoords;
+		auto n = par.size();
+		if (n == 0)
+			return;
+		auto at = [&](std::size_t j) -> vec { return j == 0 ? vec(0) : p[j * 2 - 2]; };
+
+		Accelerations(pend, acc);
+		old.resize(n);
+		for (std::size_t j = 0; j < n; j++)
+		{
+			old[j] = p[j * 2];
+			p[j * 2 + 1] += acc[j] * (h / 2);
+			p[j * 2] += p[j * 2 + 1] * h;
+		}
+
+		// SHAKE: move along old link directions until lengths are restored
+		for (int it = 0; it < maxIterations; it++)
+		{
+			bool done = true;
+			for (std::size_t j = 0; j < n; j++)
+			{
+				if (!par[j].rod)
+					continue;
+				auto d = p[j * 2] - at(j);
+				auto r2 = par[j].r * par[j].r;
+				auto diff = (d & d) - r2;
+				if (std::abs(diff) <= tolerance * r2)
+					continue;
+				done = false;
+				auto dOld = old[j] - (j == 0 ? vec(0) : old[j - 1]);
+				auto wl = InvMass(pend, j, false), wu = InvMass(pend, j, true);
+				auto gm = diff / (2 * (d & dOld) * (wl + wu));
+				p[j * 2] -= dOld * (gm * wl);
+				p[j * 2 + 1] -= dOld * (gm * wl / h);
+				if (j != 0)
+				{
+					p[j * 2 - 2] += dOld * (gm * wu);
+					p[j * 2 - 1] += dOld * (gm * wu / h);
+				}
+			}
+			if (done)
+				break;
+		}
+
+		Accelerations(pend, acc);
+		for (std::size_t j = 0; j < n; j++)
+			p[j * 2 + 1] += acc[j] * (h / 2);
+
+		// RATTLE: remove velocity along rods
+		for (int it = 0; it < maxIterations; it++)
+		{
+			bool done = true;
+			for (std::size_t j = 0; j < n; j++)
+			{
+				if (!par[j].rod)
+					continue;
+				auto d = p[j * 2] - at(j);
+				auto dv = p[j * 2 + 1] - (j == 0 ? vec(0) : p[j * 2 - 1]);
+				auto r2 = par[j].r * par[j].r;
+				auto dot = d & dv;
+				if (std::abs(dot) * h <= tolerance * r2)
+					continue;
+				done = false;
+				auto wl = InvMass(pend, j, false), wu = InvMass(pend, j, true);
+				auto km = dot / ((d & d) * (wl + wu));
+				p[j * 2 + 1] -= d * (km * wl);
+				if (j != 0)
+					p[j * 2 - 1] += d * (km * wu);
+			}
+			if (done)
+				break;
+		}
+	}
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/*
+ * Keeps a sparse history of a pendulum: full state is saved every `stride` fixed steps
+ * into a ring of `capacity` checkpoints. Seeking restores the nearest checkpoint
+ * and re-integrates at most `stride` steps, so memory is capacity states
+ * and seek time is bounded by stride solver steps.
+ */
+template<typename S = RungeKuttaSolver>
+class Rewind
+{
+private:
+	struct Checkpoint
+	{
+		std::size_t tick = 0;
+		std::vector<Pendulum::BallData> ballParams;
+		std::valarray<vec> ballCoords;
+		vec g;
+	};
+
+	std::vector<Checkpoint> ring;
+	// index of the oldest checkpoint and number of stored ones
+	std::size_t first = 0, count = 0;
+	std::size_t tick = 0, latest = 0;
+	double accumulated = 0;
+	S solver;
+
+	Checkpoint& At(std::size_t i) noexcept { return ring[(first + i) % ring.size()]; }
+	Checkpoint const& At(std::size_t i) const noexcept { return ring[(first + i) % ring.size()]; }
+
+	void Save(Pendulum const& pend)
+	{
+		Checkpoint* cp;
+		if (count == ring.size())
+		{
+			cp = &ring[first];
+			first = (first + 1) % ring.size();
+		}
+		else
+			cp = &At(count++);
+		AUDIT_SCOPE("Rewind::Save");
+		AUDIT_COPY(pend.ballParams.size() * sizeof(Pendulum::BallData) + pend.ballCoords.size() * sizeof(vec));
+		cp->tick = tick;
+		cp->ballParams = pend.ballParams;
+		cp->ballCoords.resize(pend.ballCoords.size());
+		cp->ballCoords = pend.ballCoords;
+		cp->g = pend.g;
+	}
+
+	// forget everything after current tick, history was overwritten
+	void Truncate() noexcept
+	{
+		while (count > 0 && At(count - 1).tick > tick)
+			count--;
+		latest = tick;
+	}
+public:
+	double const step;
+	std::size_t const stride;
+	// upper bound of steps done by one Advance, excess time is dropped
+	std::size_t maxSteps = 64;
+	// applied after every fixed step, replays included (collisions, see Collisions.h);
+	// Time() is already that of the new state
+	std::function<void(Pendulum&)> afterStep = nullptr;
+
+	// defaults: 240 Hz, checkpoint each second, 10 minutes of history
+	Rewind(double step = 1.0 / 240, std::size_t stride = 240, std::size_t capacity = 600, S solver = S())
+	: ring(capacity)
+	, solver(solver)
+	, step(step)
+	, stride(stride)
+	{
+		assert(capacity > 0 && stride > 0);
+	}
+
+	std::size_t Tick() const noexcept { return tick; }
+	std::size_t Latest() const noexcept { return latest; }
+	std::size_t Oldest() const noexcept { return count == 0 ? tick : At(0).tick; }
+	double Time() const noexcept { return tick * step; }
+
+	// drops history and starts a new one from current state (call after edits)
+	void Reset(Pendulum const& pend)
+	{
+		count = 0;
+		first = 0;
+		latest = tick;
+		accumulated = 0;
+		Save(pend);
+	}
+
+	// integrates delta seconds in fixed steps, delta remainder is kept for the next call
+	void Advance(Pendulum& pend, double delta)
+	{
+		if (count == 0)
+			Reset(pend);
+		if (tick != latest)
+			Truncate();
+		accumulated += delta;
+		std::size_t done = 0;
+		for (; accumulated >= step && done < maxSteps; accumulated -= step, done++)
+		{
+			pend.Step(step, solver);
+			tick++;
+			if (afterStep)
+				afterStep(pend);
+			if (tick % stride == 0)
+				Save(pend);
+		}
+		if (done == maxSteps)
+			accumulated = 0;
+		latest = tick;
+	}
+
+	// restores state at `target` tick, returns false if it is out of recorded range
+	bool Seek(Pendulum& pend, std::size_t target)
+	{
+		if (count == 0 || target < Oldest() || target > latest)
+			return false;
+		// checkpoints are sorted by tick
+		std::size_t lo = 0, hi = count;
+		while (hi - lo > 1)
+		{
+			auto mid = (lo + hi) / 2;
+			if (At(mid).tick <= target)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		auto const& cp = At(lo);
+		pend.ballParams = cp.ballParams;
+		pend.ballCoords.resize(cp.ballCoords.size());
+		pend.ballCoords = cp.ballCoords;
+		pend.g = cp.g;
+		for (tick = cp.tick; tick < target;)
+		{
+			pend.Step(step, solver);
+			tick++;
+			if (afterStep)
+				afterStep(pend);
+		}
+		tick = target;
+		accumulated = 0;
+		return true;
+	}
+
+	// relative seek in seconds, clamped to recorded range
+	void SeekBy(Pendulum& pend, double seconds)
+	{
+		auto target = static_cast<double>(tick) + seconds / step;
+		target = std::max<double>(target, Oldest());
+		target = std::min<double>(target, latest);
+		Seek(pend, static_cast<std::size_t>(target));
+	}
+};
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "Equilibrium.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Scenario files: balls, initial state, gravity, solver and step.
+ *
+ * Text form, one item per line, # starts a comment:
+ *   g x y z
+ *   solver RungeKutta | Midpoint | Euler
+ *   step seconds
+ *   ball r k m [x y z [vx vy vz]] [rod]
+ *   settle [i x y z]...
+ * a ball without position hangs r below the previous one, as AddBall does.
+ * settle starts at rest in static equilibrium instead, with balls i held at x y z.
+ *
+ * Binary form is laid out to be used in place: a 64-byte header, then a
+ * 32-byte record per ball, then x, y, z, vx, vy, vz doubles per ball.
+ * It is memory-mapped and validated, the pendulum is filled with one
+ * allocation per array, so huge chains load in O(N).
+ */
+namespace scenario
+{
+	inline constexpr std::uint64_t MAGIC = 0x314e'4543'5344'4e50; // "PNDSCEN1"
+	inline constexpr std::uint32_t VERSION = 1;
+
+	struct Header
+	{
+		std::uint64_t magic;
+		std::uint32_t version;
+		std::uint32_t solver;
+		std::uint64_t balls;
+		double g[3];
+		double step;
+		std::uint64_t reserved;
+	};
+	static_assert(sizeof(Header) == 64);
+
+	struct Ball
+	{
+		double r, k, m;
+		std::uint64_t flags;
+	};
+	static_assert(sizeof(Ball) == 32);
+	inline constexpr std::uint64_t ROD = 1;
+
+	struct Scenario
+	{
+		Pendulum pend;
+		Method solver = Method::RungeKutta;
+		double step = 1.0 / 240;
+	};
+
+	// finiteness by bits first (mth::IsFinite), the comparisons after it then see no NaN
+	inline void Validate(Scenario const& s)
+	{
+		using mth::IsFinite;
+		if (!IsFinite(s.step) || !(s.step > 0))
+			throw std::runtime_error("scenario: step must be positive");
+		if (!IsFinite(s.pend.g))
+			throw std::runtime_error("scenario: gravity is not finite");
+		if (s.pend.ballCoords.size() != s.pend.ballParams.size() * 2)
+			throw std::runtime_error("scenario: state does not match balls");
+		for (std::size_t i = 0; i < s.pend.ballParams.size(); i++)
+		{
+			auto const& b = s.pend.ballParams[i];
+			if (!IsFinite(b.m) || !IsFinite(b.r) || !IsFinite(b.k) || !(b.m > 0) || !(b.r >= 0) || !(b.k >= 0))
+				throw std::runtime_error("scenario: ball " + std::to_string(i) + " needs m > 0, r >= 0, k >= 0");
+			if (!IsFinite(s.pend.ballCoords[i * 2]) || !IsFinite(s.pend.ballCoords[i * 2 + 1]))
+				throw std::runtime_error("scenario: ball " + std::to_string(i) + " state is not finite");
+		}
+	}
+
+	inline Method ParseSolver(std::string const& name)
+	{
+		for (auto m : {Method::RungeKutta, Method::Midpoint, Method::Euler})
+			if (name == Name(m))
+				return m;
+		throw std::runtime_error("scenario: unknown solver " + name);
+	}
+
+	inline Scenario ParseText(std::istream& in)
+	{
+		Scenario s;
+		std::vector<Pendulum::BallData> balls;
+		std::vector<vec> coords;
+		std::optional<std::vector<equilibrium::Fixed>> settle;
+		std::string line;
+		for (std::size_t no = 1; std::getline(in, line); no++)
+		{
+			if (auto hash = line.find('#'); hash != std::string::npos)
+				line.resize(hash);
+			std::istringstream ls(line);
+			std::string name;
+			if (!(ls >> name))
+				continue;
+			auto fail = [&]() { return std::runtime_error("scenario: bad line " + std::to_string(no) + ": " + line); };
+			if (name == "g")
+			{
+				if (!(ls >> s.pend.g.X >> s.pend.g.Y >> s.pend.g.Z))
+					throw fail();
+			}
+			else if (name == "solver")
+			{
+				std::string solver;
+				if (!(ls >> solver))
+					throw fail();
+				s.solver = ParseSolver(solver);
+			}
+			else if (name == "step")
+			{
+				if (!(ls >> s.step))
+					throw fail();
+			}
+			else if (name == "ball")
+			{
+				Pendulum::BallData b;
+				if (!(ls >> b.r >> b.k >> b.m))
+					throw fail();
+				// optional numbers, then optional rod
+				double v[6];
+				int count = 0;
+				std::string word;
+				while (ls >> word)
+				{
+					std::istringstream ws(word);
+					char extra;
+					if (word == "rod")
+						b.rod = true;
+					else if (count == 6 || b.rod || !(ws >> v[count++]) || ws >> extra)
+						throw fail();
+				}
+				if (count != 0 && count != 3 && count != 6)
+					throw fail();
+				auto x = count >= 3 ? vec(v[0], v[1], v[2]) : coords.empty() ? vec(0, 0, -b.r) : coords[coords.size() - 2] + vec(0, 0, -b.r);
+				auto vel = count == 6 ? vec(v[3], v[4], v[5]) : vec(0);
+				balls.push_back(b);
+				coords.push_back(x);
+				coords.push_back(vel);
+			}
+			else if (name == "settle")
+			{
+				settle.emplace();
+				equilibrium::Fixed f;
+				while (ls >> f.ball)
+				{
+					if (!(ls >> f.x.X >> f.x.Y >> f.x.Z))
+						throw fail();
+					settle->push_back(f);
+				}
+				if (!ls.eof())
+					throw fail();
+			}
+			else
+				throw fail();
+		}
+		s.pend.ballParams = std::move(balls);
+		s.pend.ballCoords = std::valarray<vec>(coords.data(), coords.size());
+		if (settle)
+		{
+			for (auto const& f : *settle)
+				if (f.ball >= s.pend.ballParams.size())
+					throw std::runtime_error("scenario: settle holds missing ball " + std::to_string(f.ball));
+			if (auto report = equilibrium::Solve(s.pend, *settle); !report.converged)
+				throw std::runtime_error("scenario: no static equilibrium, residual force " + std::to_string(report.residual));
+		}
+		Validate(s);
+		return s;
+	}
+
+	inline void SaveText(std::ostream& out, Scenario const& s)
+	{
+		out.precision(17);
+		out << "g " << s.pend.g.X << ' ' << s.pend.g.Y << ' ' << s.pend.g.Z << '\n'
+			<< "solver " << Name(s.solver) << '\n'
+			<< "step " << s.step << '\n'
+			<< "# ball r k m x y z vx vy vz [rod]\n";
+		for (std::size_t i = 0; i < s.pend.ballParams.size(); i++)
+		{
+			auto const& b = s.pend.ballParams[i];
+			auto const& x = s.pend.ballCoords[i * 2];
+			auto const& v = s.pend.ballCoords[i * 2 + 1];
+			out << "ball " << b.r << ' ' << b.k << ' ' << b.m << ' '
+				<< x.X << ' ' << x.Y << ' ' << x.Z << ' ' << v.X << ' ' << v.Y << ' ' << v.Z << (b.rod ? " rod\n" : "\n");
+		}
+	}
+
+	inline void SaveBinary(std::ostream& out, Scenario const& s)
+	{
+		Validate(s);
+		Header h = {};
+		h.magic = MAGIC;
+		h.version = VERSION;
+		h.solver = static_cast<std::uint32_t>(s.solver);
+		h.balls = s.pend.ballParams.size();
+		h.g[0] = s.pend.g.X;
+		h.g[1] = s.pend.g.Y;
+		h.g[2] = s.pend.g.Z;
+		h.step = s.step;
+		out.write(reinterpret_cast<char const*>(&h), sizeof(h));
+		for (auto const& b : s.pend.ballParams)
+		{
+			Ball rec = {b.r, b.k, b.m, b.rod ? ROD : 0};
+			out.write(reinterpret_cast<char const*>(&rec), sizeof(rec));
+		}
+		for (auto const& v : s.pend.ballCoords)
+		{
+			double d[3] = {v.X, v.Y, v.Z};
+			out.write(reinterpret_cast<char const*>(d), sizeof(d));
+		}
+	}
+
+	// read-only mapping of a binary scenario, records are used in place
+	class Mapped
+	{
+	private:
+		void* base = MAP_FAILED;
+		std::size_t size = 0;
+
+	public:
+		explicit Mapped(std::string const& path)
+		{
+			int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				throw std::runtime_error("scenario: cannot open " + path);
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header)))
+			{
+				close(fd);
+				throw std::runtime_error("scenario: " + path + " is too short");
+			}
+			size = st.st_size;
+			base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (base == MAP_FAILED)
+				throw std::runtime_error("scenario: mmap failed for " + path);
+			madvise(base, size, MADV_SEQUENTIAL);
+			auto const& h = Head();
+			char const* error = nullptr;
+			if (h.magic != MAGIC || h.version != VERSION)
+				error = " is not a binary scenario of this version";
+			else if (h.balls > (size - sizeof(Header)) / (sizeof(Ball) + 6 * sizeof(double))
+					|| size != sizeof(Header) + h.balls * (sizeof(Ball) + 6 * sizeof(double)))
+				error = " size does not match its ball count";
+			else if (h.solver > static_cast<std::uint32_t>(Method::Euler))
+				error = " has unknown solver";
+			if (error)
+			{
+				munmap(base, size);
+				base = MAP_FAILED;
+				throw std::runtime_error("scenario: " + path + error);
+			}
+		}
+		~Mapped()
+		{
+			if (base != MAP_FAILED)
+				munmap(base, size);
+		}
+		Mapped(Mapped const&) = delete;
+		Mapped& operator=(Mapped const&) = delete;
+
+		Header const& Head() const noexcept { return *reinterpret_cast<Header const*>(base); }
+		std::size_t Count() const noexcept { return Head().balls; }
+		Ball const* Balls() const noexcept { return reinterpret_cast<Ball const*>(static_cast<char const*>(base) + sizeof(Header)); }
+		// x, y, z, vx, vy, vz per ball
+		double const* State() const noexcept { return reinterpret_cast<double const*>(Balls() + Count()); }
+
+		Scenario Load() const
+		{
+			auto const& h = Head();
+			auto n = Count();
+			Scenario s;
+			s.solver = static_cast<Method>(h.solver);
+			s.step = h.step;
+			s.pend.g = vec(h.g[0], h.g[1], h.g[2]);
+			s.pend.ballParams.resize(n);
+			s.pend.ballCoords.resize(n * 2);
+			auto balls = Balls();
+			auto state = State();
+			for (std::size_t i = 0; i < n; i++)
+			{
+				auto const& b = balls[i];
+				s.pend.ballParams[i] = {b.r, b.m, b.k, (b.flags & ROD) != 0};
+				s.pend.ballCoords[i * 2] = vec(state[i * 6], state[i * 6 + 1], state[i * 6 + 2]);
+				s.pend.ballCoords[i * 2 + 1] = vec(state[i * 6 + 3], state[i * 6 + 4], state[i * 6 + 5]);
+			}
+			Validate(s);
+			return s;
+		}
+	};
+
+	inline bool IsBinary(std::string const& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::uint64_t magic = 0;
+		in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+		return in && magic == MAGIC;
+	}
+
+	// either form, told apart by the magic
+	inline Scenario Load(std::string const& path)
+	{
+		if (IsBinary(path))
+			return Mapped(path).Load();
+		std::ifstream in(path);
+		if (!in)
+			throw std::runtime_error("scenario: cannot open " + path);
+		return ParseText(in);
+	}
+
+	inline void Save(std::string const& path, Scenario const& s, bool binary)
+	{
+		std::ofstream out(path, binary ? std::ios::binary : std::ios::out);
+		if (!out)
+			throw std::runtime_error("scenario: cannot write " + path);
+		if (binary)
+			SaveBinary(out, s);
+		else
+			SaveText(out, s);
+	}
+} // namespace scenario
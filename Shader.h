@@ -1,6 +1,12 @@
 #pragma once
 
+// the offscreen export has no GLEW and takes GL 2.0 entry points from libGL directly
+#ifdef GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#else
 #include <GL/glew.h>
+#endif
 
 #include <stdexcept>
 #include <string>
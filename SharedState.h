@@ -0,0 +1,222 @@
+#pragma once
+
+#include "pendulum.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Pendulum state published through a POSIX shared memory ring.
+ * Each slot is guarded by its own seqlock: odd sequence while it is written,
+ * even once complete. Readers look at slot memory in place and only re-check
+ * the sequence afterwards, there is no syscall and no copy per frame.
+ *
+ * Ball layout in a slot: x, y, z, vx, vy, vz as doubles.
+ */
+namespace shm
+{
+	inline constexpr std::uint64_t MAGIC = 0x4d55'4c55'444e'4550; // "PENDULUM"
+
+	struct Header
+	{
+		std::uint64_t magic;
+		std::uint32_t slotCount;
+		std::uint32_t maxBalls;
+		std::uint64_t slotSize;
+		// number of the last complete frame + 1, 0 if nothing was published
+		alignas(64) std::atomic<std::uint64_t> published;
+	};
+
+	struct Slot
+	{
+		std::atomic<std::uint64_t> seq;
+		std::uint64_t frame;
+		std::int64_t stamp; // steady_clock nanoseconds at publication
+		double time;
+		std::uint32_t balls;
+		std::uint32_t pad;
+		double data[1];
+	};
+
+	inline std::uint64_t SlotSize(std::uint32_t maxBalls) noexcept
+	{
+		auto sz = offsetof(Slot, data) + sizeof(double) * 6 * maxBalls;
+		// keep slots on separate cache lines
+		return (sz + 63) / 64 * 64;
+	}
+
+	inline std::uint64_t RegionSize(std::uint32_t slotCount, std::uint32_t maxBalls) noexcept
+	{
+		return 64 * ((sizeof(Header) + 63) / 64) + SlotSize(maxBalls) * slotCount;
+	}
+
+	class Mapping
+	{
+	protected:
+		void* base = MAP_FAILED;
+		std::size_t size = 0;
+
+		Header* Head() const noexcept { return reinterpret_cast<Header*>(base); }
+		Slot* SlotAt(std::uint64_t frame) const noexcept
+		{
+			auto h = Head();
+			auto first = reinterpret_cast<char*>(base) + 64 * ((sizeof(Header) + 63) / 64);
+			return reinterpret_cast<Slot*>(first + (frame % h->slotCount) * h->slotSize);
+		}
+	public:
+		Mapping() = default;
+		Mapping(Mapping const&) = delete;
+		Mapping& operator=(Mapping const&) = delete;
+		~Mapping()
+		{
+			if (base != MAP_FAILED)
+				munmap(base, size);
+		}
+	};
+
+	class Publisher : public Mapping
+	{
+	private:
+		std::string name;
+		std::uint64_t frame = 0;
+	public:
+		// creates (or recreates) shared memory object `name`, e.g. "/pendulum"
+		Publisher(std::string name, std::uint32_t maxBalls, std::uint32_t slotCount = 64)
+		: name(std::move(name))
+		{
+			int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+			if (fd < 0)
+				throw std::runtime_error("shm_open failed for " + this->name);
+			size = RegionSize(slotCount, maxBalls);
+			if (ftruncate(fd, size) != 0)
+			{
+				close(fd);
+				throw std::runtime_error("ftruncate failed for " + this->name);
+			}
+			base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (base == MAP_FAILED)
+				throw std::runtime_error("mmap failed for " + this->name);
+			auto h = Head();
+			h->slotCount = slotCount;
+			h->maxBalls = maxBalls;
+			h->slotSize = SlotSize(maxBalls);
+			h->published.store(0, std::memory_order_relaxed);
+			for (std::uint32_t i = 0; i < slotCount; i++)
+				SlotAt(i)->seq.store(0, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			h->magic = MAGIC;
+		}
+		~Publisher() { shm_unlink(name.c_str()); }
+
+		// balls over maxBalls are not published
+		void Publish(Pendulum const& pend, double time = 0)
+		{
+			AUDIT_SCOPE("shm::Publish");
+			auto h = Head();
+			auto slot = SlotAt(frame);
+			auto seq = slot->seq.load(std::memory_order_relaxed);
+			slot->seq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+
+			auto balls = std::min<std::size_t>(pend.ballParams.size(), h->maxBalls);
+			slot->frame = frame;
+			slot->stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+			slot->time = time;
+			slot->balls = static_cast<std::uint32_t>(balls);
+			auto out = slot->data;
+			for (std::size_t i = 0; i < balls * 2; i++, out += 3)
+			{
+				auto const& v = pend.ballCoords[i];
+				out[0] = v.X;
+				out[1] = v.Y;
+				out[2] = v.Z;
+			}
+
+			slot->seq.store(seq + 2, std::memory_order_release);
+			h->published.store(++frame, std::memory_order_release);
+		}
+	};
+
+	// view of a slot, valid only inside Reader::Visit callback
+	struct Frame
+	{
+		std::uint64_t frame;
+		std::int64_t stamp;
+		double time;
+		std::uint32_t balls;
+		double const* data;
+	};
+
+	class Reader : public Mapping
+	{
+	public:
+		explicit Reader(std::string const& name)
+		{
+			int fd = shm_open(name.c_str(), O_RDONLY, 0);
+			if (fd < 0)
+				throw std::runtime_error("shm_open failed for " + name);
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header)))
+			{
+				close(fd);
+				throw std::runtime_error("shared state " + name + " is not initialized");
+			}
+			size = st.st_size;
+			base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			if (base == MAP_FAILED)
+				throw std::runtime_error("mmap failed for " + name);
+			if (Head()->magic != MAGIC || RegionSize(Head()->slotCount, Head()->maxBalls) > size)
+				throw std::runtime_error("shared state " + name + " has unknown layout");
+		}
+
+		// number of frames published so far
+		std::uint64_t Published() const noexcept { return Head()->published.load(std::memory_order_acquire); }
+
+		/*
+		 * Calls f(Frame const&) on the slot of `frame` in place.
+		 * Returns false if the frame was already overwritten or was overwritten during f,
+		 * in which case whatever f computed must be discarded.
+		 */
+		template<typename F>
+		bool Visit(std::uint64_t frame, F&& f) const
+		{
+			auto slot = SlotAt(frame);
+			auto seq = slot->seq.load(std::memory_order_acquire);
+			if ((seq & 1) != 0 || slot->frame != frame)
+				return false;
+			Frame fr{slot->frame, slot->stamp, slot->time, std::min(slot->balls, Head()->maxBalls), slot->data};
+			f(static_cast<Frame const&>(fr));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return slot->seq.load(std::memory_order_relaxed) == seq;
+		}
+
+		// visits the newest frame, retrying while the writer laps it
+		template<typename F>
+		bool VisitLatest(F&& f) const
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				auto p = Published();
+				if (p == 0)
+					return false;
+				if (Visit(p - 1, f))
+					return true;
+			}
+			return false;
+		}
+	};
+} // namespace shm
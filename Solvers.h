@@ -2,6 +2,9 @@
 
 #include "mth/vec.h"
 
+#include <utility>
+#include <variant>
+
 template<typename T, typename Y>
 std::valarray<T>& operator*=(std::valarray<T>& l, Y const& r)
 {
@@ -70,20 +73,133 @@ V Midpoint(F const& f, V const& x0, T h)
 	return ret;
 }
 
+/*
+ * Buffers of the in-place forms below. They belong to one owner:
+ * copies start empty, so copying the owner does not copy scratch data.
+ */
+template<typename V>
+struct SolverWork
+{
+	V k[4], tmp;
+
+	SolverWork() = default;
+	SolverWork(SolverWork const&) noexcept {}
+	SolverWork& operator=(SolverWork const&) noexcept { return *this; }
+
+	void Fit(std::size_t n)
+	{
+		for (auto& v : k)
+			if (v.size() != n)
+				v.resize(n);
+		if (tmp.size() != n)
+			tmp.resize(n);
+	}
+};
+
+/*
+ * Same schemes, same arithmetic, without temporaries: fill(x, h, out) writes
+ * the derivative into out and x is advanced in place.
+ * Allocation-free once work has the size of x.
+ */
+template<typename F, typename V, typename T>
+void RungeKuttaInPlace(F const& fill, V& x, T h, SolverWork<V>& w)
+{
+	using namespace mth;
+	auto n = x.size();
+	w.Fit(n);
+	auto hd2 = h / 2;
+	auto stage = [&](V const& k, T t, V& out) {
+		for (std::size_t i = 0; i < n; i++)
+			w.tmp[i] = x[i] + k[i] * t;
+		fill(w.tmp, t, out);
+	};
+	fill(x, 0, w.k[0]);
+	stage(w.k[0], hd2, w.k[1]);
+	stage(w.k[1], hd2, w.k[2]);
+	stage(w.k[2], h, w.k[3]);
+	w.k[1] *= 2;
+	w.k[2] *= 2;
+	w.k[0] += w.k[1];
+	w.k[0] += w.k[2];
+	w.k[0] += w.k[3];
+	hd2 /= 3;
+	w.k[0] *= hd2;
+	x += w.k[0];
+}
+
+template<typename F, typename V, typename T>
+void EulerInPlace(F const& fill, V& x, T h, SolverWork<V>& w)
+{
+	using namespace mth;
+	w.Fit(x.size());
+	fill(x, h, w.k[0]);
+	w.k[0] *= h;
+	x += w.k[0];
+}
+
+template<typename F, typename V, typename T>
+void MidpointInPlace(F const& fill, V& x, T h, SolverWork<V>& w)
+{
+	using namespace mth;
+	w.Fit(x.size());
+	fill(x, 0, w.k[0]);
+	auto hd2 = h / 2;
+	w.k[0] *= hd2;
+	w.k[0] += x;
+	fill(w.k[0], hd2, w.k[1]);
+	w.k[1] *= h;
+	x += w.k[1];
+}
+
 struct RungeKuttaSolver
 {
 	template<typename ...A>
 	auto operator()(A&& ...a) const { return RungeKutta(std::forward<A>(a)...); }
+	template<typename ...A>
+	void InPlace(A&& ...a) const { RungeKuttaInPlace(std::forward<A>(a)...); }
 };
 struct EulerSolver
 {
 	template<typename ...A>
 	auto operator()(A&& ...a) const { return Euler(std::forward<A>(a)...); }
+	template<typename ...A>
+	void InPlace(A&& ...a) const { EulerInPlace(std::forward<A>(a)...); }
 };
 struct MidpointSolver
 {
 	template<typename ...A>
 	auto operator()(A&& ...a) const { return Midpoint(std::forward<A>(a)...); }
+	template<typename ...A>
+	void InPlace(A&& ...a) const { MidpointInPlace(std::forward<A>(a)...); }
 };
 
+// solver chosen at runtime, as scenarios, jobs and comparisons name them
+enum class Method
+{
+	RungeKutta,
+	Midpoint,
+	Euler,
+};
+using AnySolver = std::variant<RungeKuttaSolver, MidpointSolver, EulerSolver>;
+
+inline char const* Name(Method m) noexcept
+{
+	switch (m)
+	{
+	case Method::RungeKutta: return "RungeKutta";
+	case Method::Midpoint: return "Midpoint";
+	default: return "Euler";
+	}
+}
+
+inline AnySolver Solver(Method m)
+{
+	switch (m)
+	{
+	case Method::RungeKutta: return RungeKuttaSolver();
+	case Method::Midpoint: return MidpointSolver();
+	default: return EulerSolver();
+	}
+}
+
 
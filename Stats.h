@@ -0,0 +1,330 @@
+#pragma once
+
+#include "Ensemble.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Online statistics of an ensemble, computed while it steps instead of from stored states.
+ * Every statistic takes values one by one in O(1) or bounded memory and merges with
+ * another of its kind, so workers fill private partial results that are merged once
+ * per step. An accumulator of member states has Add(params, m, state) and Merge(other);
+ * stats::Step feeds it every member right after the member is stepped.
+ *
+ *   stats::Snapshot s;
+ *   s.reference = &ref.Member(0);
+ *   auto now = stats::Step(ensemble, h, s);   // now.energy.Mean(), now.quantiles.Quantile(0.95)
+ *
+ * Counts, min, max and histograms merge exactly, as do quantiles until a sketch folds buckets,
+ * so they do not depend on the thread count. Means and variances are merged in floating point
+ * in worker order and may differ from a one-thread run in the last bits.
+ */
+namespace stats
+{
+	// accumulators ignore NaN and infinities, tested by bits since fast-math assumes there are none
+
+	// count, mean and variance by Welford's update, min and max; Merge is Chan's pairwise formula
+	struct Moments
+	{
+		std::uint64_t count = 0;
+		double mean = 0, m2 = 0;
+		// not infinities, fast-math assumes there are none
+		double min = std::numeric_limits<double>::max(), max = std::numeric_limits<double>::lowest();
+
+		void Add(double x) noexcept
+		{
+			if (!mth::IsFinite(x))
+				return;
+			count++;
+			auto d = x - mean;
+			mean += d / count;
+			m2 += d * (x - mean);
+			min = std::min(min, x);
+			max = std::max(max, x);
+		}
+
+		void Merge(Moments const& o) noexcept
+		{
+			if (o.count == 0)
+				return;
+			if (count == 0)
+			{
+				*this = o;
+				return;
+			}
+			auto n = count + o.count;
+			auto d = o.mean - mean;
+			mean += d * o.count / n;
+			m2 += o.m2 + d * d * count / n * o.count;
+			count = n;
+			min = std::min(min, o.min);
+			max = std::max(max, o.max);
+		}
+
+		double Mean() const noexcept { return mean; }
+		// sample variance
+		double Variance() const noexcept { return count > 1 ? m2 / (count - 1) : 0; }
+		double Sd() const noexcept { return std::sqrt(Variance()); }
+	};
+
+	// fixed bins over [lo, hi) with counts below and above; an empty histogram ignores values
+	struct Histogram
+	{
+		double lo = 0, hi = 0;
+		std::vector<std::uint64_t> bins;
+		std::uint64_t under = 0, over = 0;
+
+		Histogram() = default;
+		Histogram(double lo, double hi, std::size_t count)
+		: lo(lo), hi(hi), bins(count)
+		{}
+
+		void Add(double x) noexcept
+		{
+			if (bins.empty() || !mth::IsFinite(x))
+				return;
+			auto b = (x - lo) / (hi - lo) * bins.size();
+			if (!(b >= 0))
+				under++;
+			else if (b >= bins.size())
+				over++;
+			else
+				bins[std::size_t(b)]++;
+		}
+
+		void Merge(Histogram const& o)
+		{
+			if (o.bins.empty())
+				return;
+			if (bins.empty())
+			{
+				*this = o;
+				return;
+			}
+			if (o.lo != lo || o.hi != hi || o.bins.size() != bins.size())
+				throw std::runtime_error("stats: merging histograms of different bins");
+			for (std::size_t i = 0; i < bins.size(); i++)
+				bins[i] += o.bins[i];
+			under += o.under;
+			over += o.over;
+		}
+
+		std::uint64_t Count() const noexcept
+		{
+			auto n = under + over;
+			for (auto b : bins)
+				n += b;
+			return n;
+		}
+	};
+
+	/*
+	 * Quantiles within relative error alpha of the true value (DDSketch, Masson et al. 2019).
+	 * Values go to logarithmic buckets, gamma^(k - 1) < |x| <= gamma^k with gamma = (1 + alpha) / (1 - alpha),
+	 * counted separately for each sign. Buckets of sketches with the same alpha add up, so
+	 * merging is exact. Past maxBins buckets per sign the ones nearest zero are folded together,
+	 * which only loses accuracy there. |x| below tiny counts as zero.
+	 */
+	class Sketch
+	{
+	private:
+		struct Store
+		{
+			int offset = 0;
+			std::vector<std::uint64_t> counts;
+			bool collapsed = false;
+
+			void Add(int k, std::uint64_t n, std::size_t maxBins)
+			{
+				if (counts.empty())
+				{
+					offset = k;
+					counts.assign(1, 0);
+				}
+				if (k < offset)
+				{
+					if (collapsed)
+						k = offset;
+					else
+					{
+						counts.insert(counts.begin(), std::size_t(offset - k), 0);
+						offset = k;
+					}
+				}
+				else if (std::size_t(k - offset) >= counts.size())
+					counts.resize(std::size_t(k - offset) + 1, 0);
+				counts[std::size_t(k - offset)] += n;
+				if (counts.size() > maxBins)
+				{
+					auto excess = counts.size() - maxBins;
+					for (std::size_t i = 0; i < excess; i++)
+						counts[excess] += counts[i];
+					counts.erase(counts.begin(), counts.begin() + excess);
+					offset += int(excess);
+					collapsed = true;
+				}
+			}
+		};
+
+		double alpha, logGamma;
+		std::size_t maxBins;
+		Store positive, negative;
+		std::uint64_t zero = 0, count = 0;
+
+		static constexpr double tiny = 1e-12;
+
+		int Key(double a) const noexcept { return int(std::ceil(std::log(a) / logGamma)); }
+		// middle of bucket k in relative terms
+		double Value(int k) const noexcept { return 2 * std::exp(k * logGamma) / (1 + std::exp(logGamma)); }
+
+	public:
+		explicit Sketch(double alpha = 0.01, std::size_t maxBins = 2048)
+		: alpha(alpha), logGamma(std::log((1 + alpha) / (1 - alpha))), maxBins(std::max<std::size_t>(maxBins, 1))
+		{}
+
+		void Add(double x)
+		{
+			if (!mth::IsFinite(x))
+				return;
+			count++;
+			if (x > tiny)
+				positive.Add(Key(x), 1, maxBins);
+			else if (x < -tiny)
+				negative.Add(Key(-x), 1, maxBins);
+			else
+				zero++;
+		}
+
+		void Merge(Sketch const& o)
+		{
+			if (o.count == 0)
+				return;
+			if (o.alpha != alpha)
+				throw std::runtime_error("stats: merging sketches of different accuracy");
+			for (std::size_t i = 0; i < o.positive.counts.size(); i++)
+				if (o.positive.counts[i] != 0)
+					positive.Add(o.positive.offset + int(i), o.positive.counts[i], maxBins);
+			for (std::size_t i = 0; i < o.negative.counts.size(); i++)
+				if (o.negative.counts[i] != 0)
+					negative.Add(o.negative.offset + int(i), o.negative.counts[i], maxBins);
+			zero += o.zero;
+			count += o.count;
+		}
+
+		std::uint64_t Count() const noexcept { return count; }
+
+		// value of rank q (count - 1), q in [0, 1]; 0 if empty
+		double Quantile(double q) const noexcept
+		{
+			if (count == 0)
+				return 0;
+			auto rank = std::uint64_t(std::clamp(q, 0.0, 1.0) * (count - 1));
+			std::uint64_t seen = 0;
+			// most negative first
+			for (auto i = negative.counts.size(); i-- > 0;)
+				if ((seen += negative.counts[i]) > rank)
+					return -Value(negative.offset + int(i));
+			if ((seen += zero) > rank)
+				return 0;
+			for (std::size_t i = 0; i < positive.counts.size(); i++)
+				if ((seen += positive.counts[i]) > rank)
+					return Value(positive.offset + int(i));
+			return Value(positive.offset + int(positive.counts.size()) - 1);
+		}
+	};
+
+	/*
+	 * What ensemble-stats reports per step: total energy (moments, quantiles,
+	 * optionally a histogram), mean and spread of every ball's coordinates, and how many
+	 * members have some ball farther than threshold from reference, e.g. an unperturbed copy.
+	 * A member whose state or energy is not finite has blown up: it counts as diverged and
+	 * in nonFinite, and stays out of every other statistic.
+	 */
+	struct Snapshot
+	{
+		Moments energy;
+		Sketch quantiles;
+		Histogram histogram;
+		// of ball i at 3 i, 3 i + 1 and 3 i + 2 for x, y and z
+		std::vector<Moments> position;
+		Ensemble::State const* reference = nullptr;
+		double threshold = 0.1;
+		std::uint64_t members = 0, diverged = 0, nonFinite = 0;
+
+		void Add(Pendulum const& params, std::size_t, Ensemble::State const& s)
+		{
+			members++;
+			bool finite = true;
+			for (auto const& v : s)
+				finite = finite && mth::IsFinite(v);
+			auto e = finite ? params.Energy(s) : 0;
+			if (!finite || !mth::IsFinite(e))
+			{
+				nonFinite++;
+				diverged++;
+				return;
+			}
+			energy.Add(e);
+			quantiles.Add(e);
+			histogram.Add(e);
+			auto balls = params.ballParams.size();
+			position.resize(balls * 3);
+			bool far = false;
+			for (std::size_t i = 0; i < balls; i++)
+			{
+				auto const& x = s[i * 2];
+				position[i * 3].Add(x.X);
+				position[i * 3 + 1].Add(x.Y);
+				position[i * 3 + 2].Add(x.Z);
+				if (reference != nullptr)
+					far = far || (x - (*reference)[i * 2]).Len2() > threshold * threshold;
+			}
+			diverged += far;
+		}
+
+		void Merge(Snapshot const& o)
+		{
+			energy.Merge(o.energy);
+			quantiles.Merge(o.quantiles);
+			histogram.Merge(o.histogram);
+			position.resize(std::max(position.size(), o.position.size()));
+			for (std::size_t i = 0; i < o.position.size(); i++)
+				position[i].Merge(o.position[i]);
+			members += o.members;
+			diverged += o.diverged;
+			nonFinite += o.nonFinite;
+		}
+
+		double Diverged() const noexcept { return members != 0 ? double(diverged) / members : 0; }
+	};
+
+	// one step of ens, with every member added to a copy of empty right after its step
+	template<typename A>
+	A Step(Ensemble& ens, double h, A const& empty)
+	{
+		std::vector<A> partial(std::max(1u, ens.threads), empty);
+		ens.Step(h, [&](unsigned t, std::size_t m, Ensemble::State const& s) { partial[t].Add(ens.Params(), m, s); });
+		for (std::size_t t = 1; t < partial.size(); t++)
+			partial[0].Merge(partial[t]);
+		return std::move(partial[0]);
+	}
+
+	// members of ens as they are, in parallel
+	template<typename A>
+	A Reduce(Ensemble const& ens, A const& empty)
+	{
+		std::vector<A> partial(std::max(1u, ens.threads), empty);
+		ParallelFor(ens.Size(), ens.threads, [&](std::size_t begin, std::size_t end, unsigned t) {
+			for (auto m = begin; m < end; m++)
+				partial[t].Add(ens.Params(), m, ens.Member(m));
+		});
+		for (std::size_t t = 1; t < partial.size(); t++)
+			partial[0].Merge(partial[t]);
+		return std::move(partial[0]);
+	}
+} // namespace stats
@@ -0,0 +1,543 @@
+#pragma once
+
+#include "Scenario.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/*
+ * Parameter sweeps over BallData sharded across worker processes.
+ *
+ * A spec is a text scenario (see Scenario.h) plus sweep lines:
+ *   duration seconds
+ *   shard points          # points per shard, 0 picks by worker count
+ *   vary ball r|k|m from to count
+ * Points are the cartesian product of all vary lines, the last one changing fastest.
+ *
+ * The coordinator listens on a Unix domain socket, forks local workers that connect
+ * to it (others may connect from outside, e.g. sweep-tool worker path) and hands
+ * each idle worker the next shard, so fast workers take more. Workers stream one
+ * result per point. When a worker dies, the points of its shard it has not answered
+ * go back to the queue and a replacement is forked; a shard that keeps killing
+ * workers is reported as failed after `attempts` tries instead of stalling the run.
+ */
+namespace sweep
+{
+	struct Axis
+	{
+		std::size_t ball;
+		char field; // 'r', 'k' or 'm'
+		double from, to;
+		std::size_t count;
+
+		double Value(std::size_t i) const noexcept { return count > 1 ? from + (to - from) * i / (count - 1) : from; }
+		std::string Name() const { return "ball" + std::to_string(ball) + "." + field; }
+	};
+
+	struct Spec
+	{
+		scenario::Scenario base;
+		double duration = 1;
+		std::size_t shard = 0;
+		std::vector<Axis> axes;
+		// as parsed, sent to workers verbatim
+		std::string text;
+
+		std::size_t Points() const noexcept
+		{
+			std::size_t n = 1;
+			for (auto const& a : axes)
+				n *= a.count;
+			return n;
+		}
+
+		// axis values of point `index`
+		std::vector<double> Values(std::size_t index) const
+		{
+			std::vector<double> v(axes.size());
+			for (auto i = axes.size(); i-- > 0;)
+			{
+				v[i] = axes[i].Value(index % axes[i].count);
+				index /= axes[i].count;
+			}
+			return v;
+		}
+	};
+
+	inline Spec ParseSpec(std::string const& text)
+	{
+		Spec s;
+		s.text = text;
+		std::istringstream in(text);
+		// sweep lines become empty lines, so scenario errors keep their line numbers
+		std::string scene, line;
+		for (std::size_t no = 1; std::getline(in, line); no++)
+		{
+			auto code = line.substr(0, line.find('#'));
+			std::istringstream ls(code);
+			std::string name;
+			ls >> name;
+			auto fail = [&]() { return std::runtime_error("sweep: bad line " + std::to_string(no) + ": " + line); };
+			if (name == "duration")
+			{
+				if (!(ls >> s.duration) || !(s.duration >= 0))
+					throw fail();
+			}
+			else if (name == "shard")
+			{
+				if (!(ls >> s.shard))
+					throw fail();
+			}
+			else if (name == "vary")
+			{
+				Axis a;
+				if (!(ls >> a.ball >> a.field >> a.from >> a.to >> a.count) || a.count == 0
+						|| (a.field != 'r' && a.field != 'k' && a.field != 'm'))
+					throw fail();
+				s.axes.push_back(a);
+			}
+			else
+			{
+				scene += line;
+			}
+			scene += '\n';
+		}
+		std::istringstream sin(scene);
+		s.base = scenario::ParseText(sin);
+		for (auto const& a : s.axes)
+			if (a.ball >= s.base.pend.ballParams.size())
+				throw std::runtime_error("sweep: " + a.Name() + " is past the last ball");
+		return s;
+	}
+
+	inline Spec LoadSpec(std::string const& path)
+	{
+		std::ifstream in(path);
+		if (!in)
+			throw std::runtime_error("sweep: cannot open " + path);
+		std::ostringstream text;
+		text << in.rdbuf();
+		return ParseSpec(text.str());
+	}
+
+	struct Outcome
+	{
+		std::uint64_t index;
+		double energy0, energy;
+		// last ball at the end
+		double x[3];
+		std::uint32_t ok;
+		std::uint32_t pad;
+	};
+
+	// one point in this process
+	inline Outcome Evaluate(Spec const& spec, std::size_t index)
+	{
+		Outcome o = {};
+		o.index = index;
+		try
+		{
+			auto s = spec.base;
+			auto values = spec.Values(index);
+			for (std::size_t i = 0; i < spec.axes.size(); i++)
+			{
+				auto& b = s.pend.ballParams[spec.axes[i].ball];
+				(spec.axes[i].field == 'r' ? b.r : spec.axes[i].field == 'k' ? b.k : b.m) = values[i];
+			}
+			scenario::Validate(s);
+			auto& pend = s.pend;
+			o.energy0 = pend.ballParams.empty() ? 0 : pend.Energy(pend.ballCoords);
+			auto n = static_cast<std::size_t>(std::ceil(spec.duration / s.step - 1e-9));
+			auto h = n ? spec.duration / n : 0;
+			auto solver = Solver(s.solver);
+			std::visit([&](auto const& sv) {
+				for (std::size_t i = 0; i < n; i++)
+					pend.Step(h, sv);
+			}, solver);
+			o.energy = pend.ballParams.empty() ? 0 : pend.Energy(pend.ballCoords);
+			if (!pend.ballParams.empty())
+			{
+				auto const& x = pend.ballCoords[pend.ballCoords.size() - 2];
+				o.x[0] = x.X;
+				o.x[1] = x.Y;
+				o.x[2] = x.Z;
+			}
+			// by bits, std::isfinite is always true under -ffast-math
+			o.ok = mth::IsFinite(o.energy);
+			for (auto const& v : pend.ballCoords)
+				o.ok = o.ok && mth::IsFinite(v);
+		}
+		catch (std::exception const&)
+		{
+			o.ok = 0;
+		}
+		return o;
+	}
+
+	// wire format: Message header, then `size` payload bytes
+	enum class Kind : std::uint32_t
+	{
+		Spec = 1, // coordinator -> worker, spec text
+		Shard,    // coordinator -> worker, ShardMsg
+		Result,   // worker -> coordinator, Outcome
+		Done,     // worker -> coordinator, shard id
+	};
+
+	struct Message
+	{
+		Kind kind;
+		std::uint32_t size;
+	};
+
+	struct ShardMsg
+	{
+		std::uint64_t id, begin, end;
+	};
+
+	inline bool SendAll(int fd, void const* data, std::size_t size) noexcept
+	{
+		auto p = static_cast<char const*>(data);
+		while (size > 0)
+		{
+			auto n = send(fd, p, size, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	inline bool RecvAll(int fd, void* data, std::size_t size) noexcept
+	{
+		auto p = static_cast<char*>(data);
+		while (size > 0)
+		{
+			auto n = recv(fd, p, size, 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	inline bool Send(int fd, Kind kind, void const* payload, std::size_t size) noexcept
+	{
+		Message m = {kind, static_cast<std::uint32_t>(size)};
+		return SendAll(fd, &m, sizeof(m)) && SendAll(fd, payload, size);
+	}
+
+	inline sockaddr_un Address(std::string const& path)
+	{
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path))
+			throw std::runtime_error("sweep: socket path too long: " + path);
+		std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+		return addr;
+	}
+
+	// worker process body: connect, take the spec, answer shards until the coordinator closes
+	inline int Worker(std::string const& path)
+	{
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		auto addr = Address(path);
+		if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+			return 1;
+		std::optional<Spec> spec;
+		Message m;
+		while (RecvAll(fd, &m, sizeof(m)))
+		{
+			std::string payload(m.size, '\0');
+			if (!RecvAll(fd, payload.data(), m.size))
+				break;
+			if (m.kind == Kind::Spec)
+				spec = ParseSpec(payload);
+			else if (m.kind == Kind::Shard && spec && m.size == sizeof(ShardMsg))
+			{
+				ShardMsg sh;
+				std::memcpy(&sh, payload.data(), sizeof(sh));
+				for (auto i = sh.begin; i < sh.end; i++)
+				{
+					auto o = Evaluate(*spec, i);
+					if (!Send(fd, Kind::Result, &o, sizeof(o)))
+						return 1;
+				}
+				if (!Send(fd, Kind::Done, &sh.id, sizeof(sh.id)))
+					return 1;
+			}
+		}
+		close(fd);
+		return 0;
+	}
+
+	class Coordinator
+	{
+	public:
+		struct Report
+		{
+			std::size_t points = 0, ok = 0, failed = 0;
+			std::size_t shards = 0, retried = 0, crashes = 0;
+			double seconds = 0;
+		};
+
+	private:
+		struct Shard
+		{
+			std::uint64_t begin, end;
+			unsigned attempts = 0;
+		};
+		struct Peer
+		{
+			int fd;
+			pid_t pid; // 0 for workers started elsewhere
+			std::string buffer;
+			std::optional<Shard> shard;
+			std::uint64_t shardId = 0;
+		};
+
+		Spec const& spec;
+		std::string path;
+		int listener = -1;
+		std::vector<Peer> peers;
+		std::deque<Shard> queue;
+		std::uint64_t nextId = 0;
+		std::size_t forked = 0;
+		// forked but not connected yet
+		std::vector<pid_t> pending;
+		Report rep;
+
+		void Fork()
+		{
+			auto pid = fork();
+			if (pid < 0)
+				throw std::runtime_error("sweep: fork failed");
+			if (pid == 0)
+			{
+				close(listener);
+				for (auto const& p : peers)
+					close(p.fd);
+				_exit(Worker(path));
+			}
+			forked++;
+			pending.push_back(pid);
+		}
+
+		void Accept()
+		{
+			int fd = accept(listener, nullptr, nullptr);
+			if (fd < 0)
+				return;
+			pid_t pid = 0;
+			ucred cred;
+			socklen_t len = sizeof(cred);
+			if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+				if (auto it = std::find(pending.begin(), pending.end(), cred.pid); it != pending.end())
+				{
+					pid = cred.pid;
+					pending.erase(it);
+				}
+			if (!Send(fd, Kind::Spec, spec.text.data(), spec.text.size()))
+			{
+				close(fd);
+				return;
+			}
+			Peer& p = peers.emplace_back();
+			p.fd = fd;
+			p.pid = pid;
+		}
+
+		void Assign(Peer& p)
+		{
+			if (p.shard || queue.empty())
+				return;
+			auto sh = queue.front();
+			queue.pop_front();
+			sh.attempts++;
+			ShardMsg msg = {++nextId, sh.begin, sh.end};
+			p.shard = sh;
+			p.shardId = msg.id;
+			// a failed send shows up as a hang-up on the next poll
+			Send(p.fd, Kind::Shard, &msg, sizeof(msg));
+		}
+
+		void Fail(Shard const& sh, std::function<void(Outcome const&)> const& sink)
+		{
+			for (auto i = sh.begin; i < sh.end; i++)
+			{
+				Outcome o = {};
+				o.index = i;
+				sink(o);
+				rep.failed++;
+			}
+		}
+
+		// false once the peer is gone
+		bool Receive(Peer& p, std::function<void(Outcome const&)> const& sink)
+		{
+			char chunk[1 << 16];
+			auto n = recv(p.fd, chunk, sizeof(chunk), 0);
+			if (n < 0 && (errno == EINTR || errno == EAGAIN))
+				return true;
+			if (n <= 0)
+				return false;
+			p.buffer.append(chunk, n);
+			std::size_t at = 0;
+			while (p.buffer.size() - at >= sizeof(Message))
+			{
+				Message m;
+				std::memcpy(&m, p.buffer.data() + at, sizeof(m));
+				if (p.buffer.size() - at - sizeof(m) < m.size)
+					break;
+				auto payload = p.buffer.data() + at + sizeof(m);
+				if (m.kind == Kind::Result && m.size == sizeof(Outcome) && p.shard)
+				{
+					Outcome o;
+					std::memcpy(&o, payload, sizeof(o));
+					// results of a shard come in order, what is left is [begin, end)
+					if (o.index == p.shard->begin)
+					{
+						p.shard->begin++;
+						(o.ok ? rep.ok : rep.failed)++;
+						sink(o);
+					}
+				}
+				else if (m.kind == Kind::Done && m.size == sizeof(std::uint64_t))
+				{
+					std::uint64_t id;
+					std::memcpy(&id, payload, sizeof(id));
+					if (p.shard && id == p.shardId)
+						p.shard.reset();
+				}
+				at += sizeof(m) + m.size;
+			}
+			p.buffer.erase(0, at);
+			return true;
+		}
+
+		void Lost(Peer& p, std::function<void(Outcome const&)> const& sink)
+		{
+			close(p.fd);
+			rep.crashes++;
+			if (p.pid)
+			{
+				int status;
+				waitpid(p.pid, &status, 0);
+			}
+			if (p.shard && p.shard->begin < p.shard->end)
+			{
+				if (p.shard->attempts >= attempts)
+					Fail(*p.shard, sink);
+				else
+				{
+					rep.retried++;
+					queue.push_front(*p.shard);
+				}
+			}
+			if (p.pid && forked < workers + maxRespawns)
+				Fork();
+		}
+
+	public:
+		unsigned workers;
+		// tries per shard before its points are reported failed
+		unsigned attempts = 3;
+		// replacement workers over the whole run
+		std::size_t maxRespawns;
+
+		Coordinator(Spec const& spec, std::string path, unsigned workers)
+		: spec(spec), path(std::move(path)), workers(std::max(1u, workers)), maxRespawns(4 * this->workers)
+		{}
+		// closing the sockets ends the workers
+		~Coordinator()
+		{
+			if (listener >= 0)
+			{
+				close(listener);
+				unlink(path.c_str());
+			}
+			for (auto& p : peers)
+				close(p.fd);
+			for (auto& p : peers)
+				if (p.pid)
+					waitpid(p.pid, nullptr, 0);
+			for (auto pid : pending)
+				waitpid(pid, nullptr, 0);
+		}
+		Coordinator(Coordinator const&) = delete;
+		Coordinator& operator=(Coordinator const&) = delete;
+
+		// sink gets every point once, in completion order; failed points have ok == 0
+		Report Run(std::function<void(Outcome const&)> const& sink)
+		{
+			auto start = std::chrono::steady_clock::now();
+			rep = {};
+			rep.points = spec.Points();
+			auto size = spec.shard ? spec.shard : std::max<std::size_t>(1, rep.points / (workers * 16));
+			for (std::size_t b = 0; b < rep.points; b += size)
+				queue.push_back({b, std::min(rep.points, b + size)});
+			rep.shards = queue.size();
+
+			listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			auto addr = Address(path);
+			unlink(path.c_str());
+			if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 64) != 0)
+				throw std::runtime_error("sweep: cannot listen on " + path);
+			for (unsigned i = 0; i < workers; i++)
+				Fork();
+
+			std::vector<pollfd> fds;
+			while (rep.ok + rep.failed < rep.points)
+			{
+				// forked workers that died before connecting
+				for (auto it = pending.begin(); it != pending.end();)
+					if (waitpid(*it, nullptr, WNOHANG) == *it)
+					{
+						it = pending.erase(it);
+						rep.crashes++;
+						if (forked < workers + maxRespawns)
+							Fork();
+					}
+					else
+						++it;
+				if (peers.empty() && pending.empty())
+					throw std::runtime_error("sweep: no workers left");
+
+				for (auto& p : peers)
+					Assign(p);
+				fds.assign(1, {listener, POLLIN, 0});
+				for (auto const& p : peers)
+					fds.push_back({p.fd, POLLIN, 0});
+				if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR)
+					throw std::runtime_error("sweep: poll failed");
+				// peers first, Accept appends to them
+				for (std::size_t i = peers.size(); i-- > 0;)
+					if (fds[i + 1].revents && !Receive(peers[i], sink))
+					{
+						auto p = std::move(peers[i]);
+						peers.erase(peers.begin() + i);
+						Lost(p, sink);
+					}
+				if (fds[0].revents & POLLIN)
+					Accept();
+			}
+			rep.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			return rep;
+		}
+	};
+} // namespace sweep
@@ -0,0 +1,84 @@
+#include <iostream>
+
+#include "Audit.h"
+#include "Forces.h"
+
+/*
+ * Stepping must not allocate once scratch buffers have their size: every solver,
+ * its in-place form and forces::Step run in AUDIT_NO_ALLOC scopes after one warm-up step.
+ * Built with PENDULUM_AUDIT, fails if any allocation was counted there.
+ */
+namespace
+{
+	constexpr double h = 1.0 / 240;
+
+	Pendulum Chain()
+	{
+		Pendulum pend;
+		pend.AddBall({0.5, 0.3, 50}, {0.3, 0, -0.4});
+		pend.AddBall({0.5, 0.3, 50});
+		pend.AddBall({0.4, 0.2, 40});
+		return pend;
+	}
+
+	template<typename S>
+	void Solver(char const* name, S const& solver)
+	{
+		auto before = audit::Violations();
+		auto pend = Chain();
+		pend.Step(h, solver);
+		{
+			AUDIT_NO_ALLOC();
+			for (int i = 0; i < 100; i++)
+				pend.Step(h, solver);
+		}
+
+		// the in-place form on its own
+		auto x = pend.ballCoords;
+		SolverWork<std::valarray<vec>> work;
+		auto fill = [&pend](auto const& p, double d, auto& out) { pend.Derivative(p, d, out); };
+		solver.InPlace(fill, x, h, work);
+		{
+			AUDIT_NO_ALLOC();
+			for (int i = 0; i < 100; i++)
+				solver.InPlace(fill, x, h, work);
+		}
+
+		for (auto const* p : forces::presetNames)
+		{
+			auto terms = forces::MakePreset(p);
+			forces::Step(pend, terms, 0, h, solver);
+			AUDIT_NO_ALLOC();
+			for (int i = 1; i <= 100; i++)
+				forces::Step(pend, terms, i * h, h, solver);
+		}
+
+		forces::Pipeline<forces::Thermal> bath;
+		auto& thermal = std::get<0>(bath.terms);
+		thermal.Draw(0, pend.ballParams.size(), h);
+		forces::Step(pend, bath, 0, h, solver);
+		{
+			AUDIT_NO_ALLOC();
+			for (int i = 1; i <= 100; i++)
+			{
+				thermal.Draw(i, pend.ballParams.size(), h);
+				forces::Step(pend, bath, i * h, h, solver);
+			}
+		}
+
+		std::cout << name << ": " << audit::Violations() - before << " allocations" << std::endl;
+	}
+} // namespace
+
+int main()
+{
+	if (!audit::enabled)
+	{
+		std::cerr << "audit-test needs PENDULUM_AUDIT" << std::endl;
+		return 1;
+	}
+	Solver("RungeKutta", RungeKuttaSolver());
+	Solver("Euler", EulerSolver());
+	Solver("Midpoint", MidpointSolver());
+	return audit::Violations() == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "Scenario.h"
+#include "Stats.h"
+
+/*
+ * Per-step statistics of a perturbed ensemble as CSV, computed online while it steps
+ * (Stats.h), so memory does not grow with members or duration.
+ * usage: ensemble-stats [--scenario file] [--members 100000] [--spread 0.01] [--duration 10]
+ *                       [--every 24] [--threshold 0.1] [--thermal kT] [--threads n] [--seed 1]
+ */
+int main(int argc, char* argv[])
+{
+	std::unique_ptr<scenario::Scenario> scene;
+	std::size_t members = 100000, every = 24;
+	double spread = 0.01, duration = 10, threshold = 0.1, kT = 0;
+	unsigned threads = 0;
+	std::uint64_t seed = 1;
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string a = argv[i];
+			auto next = [&]() {
+				if (i + 1 >= argc)
+					throw std::runtime_error("missing value of " + a);
+				return std::string(argv[++i]);
+			};
+			if (a == "--scenario")
+				scene = std::make_unique<scenario::Scenario>(scenario::Load(next()));
+			else if (a == "--members")
+			{
+				members = std::stoull(next());
+				if (members == 0)
+					throw std::runtime_error("--members must be at least 1");
+			}
+			else if (a == "--spread")
+				spread = std::stod(next());
+			else if (a == "--duration")
+				duration = std::stod(next());
+			else if (a == "--every")
+				every = std::max<std::size_t>(1, std::stoull(next()));
+			else if (a == "--threshold")
+				threshold = std::stod(next());
+			else if (a == "--thermal")
+				kT = std::stod(next());
+			else if (a == "--threads")
+				threads = std::stoul(next());
+			else if (a == "--seed")
+				seed = std::stoull(next());
+			else
+				throw std::runtime_error("unknown option " + a);
+		}
+	}
+	catch (std::exception const& e)
+	{
+		std::cerr << e.what() << "\n"
+				  << "usage: ensemble-stats [--scenario file] [--members 100000] [--spread 0.01] [--duration 10]\n"
+				  << "                      [--every 24] [--threshold 0.1] [--thermal kT] [--threads n] [--seed 1]" << std::endl;
+		return 2;
+	}
+
+	Pendulum pend;
+	double step = 1.0 / 240;
+	auto method = Method::RungeKutta;
+	if (scene)
+	{
+		pend = scene->pend;
+		step = scene->step;
+		method = scene->solver;
+	}
+	else
+	{
+		pend.AddBall({0.5, 0.3, 50}, {0.3, 0, -0.4});
+		pend.AddBall({0.5, 0.3, 50});
+	}
+
+	if (pend.ballParams.empty())
+	{
+		std::cerr << "no balls" << std::endl;
+		return 2;
+	}
+
+	// the unperturbed member alone, as the reference divergence is measured from
+	Ensemble ensemble(step, method), reference(step, method);
+	if (threads != 0)
+		ensemble.threads = threads;
+	reference.threads = 1;
+	if (kT > 0)
+	{
+		ensemble.thermal.emplace();
+		ensemble.thermal->kT = kT;
+		reference.thermal = ensemble.thermal;
+	}
+	ensemble.Reset(pend, members, spread, seed);
+	reference.Reset(pend, 1, 0, seed);
+
+	stats::Snapshot empty;
+	empty.reference = &reference.Member(0);
+	empty.threshold = threshold;
+
+	std::cout << "time,energy_mean,energy_sd,energy_min,energy_max,energy_p05,energy_p50,energy_p95,"
+				 "last_x_mean,last_y_mean,last_z_mean,last_spread,diverged\n";
+	auto start = std::chrono::steady_clock::now();
+	auto steps = std::size_t(duration / step + 0.5);
+	for (std::size_t n = 1; n <= steps; n++)
+	{
+		reference.Step(step);
+		auto s = stats::Step(ensemble, step, empty);
+		if (n % every != 0 && n != steps)
+			continue;
+		auto const* last = &s.position[s.position.size() - 3];
+		auto spreadNow = std::sqrt(last[0].Variance() + last[1].Variance() + last[2].Variance());
+		std::cout << ensemble.Time() << ',' << s.energy.Mean() << ',' << s.energy.Sd() << ','
+				  << s.energy.min << ',' << s.energy.max << ',' << s.quantiles.Quantile(0.05) << ','
+				  << s.quantiles.Quantile(0.5) << ',' << s.quantiles.Quantile(0.95) << ','
+				  << last[0].Mean() << ',' << last[1].Mean() << ',' << last[2].Mean() << ','
+				  << spreadNow << ',' << s.Diverged() << '\n';
+	}
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << members << " members, " << steps << " steps in " << seconds << " s, "
+			  << members * steps / seconds / 1e6 << " M member-steps/s" << std::endl;
+}
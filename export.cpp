@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Offscreen.h"
+#include "Collisions.h"
+#include "Draw.h"
+#include "Scenario.h"
+#include "shaders.h"
+#include "Shader.h"
+
+/*
+ * Renders a simulation to image files without a window, as fast as rendering allows.
+ * Frames are taken at a fixed simulated rate, the pendulum steps at the scenario step in between.
+ * usage: pendulum-export [--scenario file] [--fps 60] [--duration 10] [--size 640x480]
+ *                        [--png dir = frames | --raw file|-] [--writers threads]
+ * raw output plays with: ffmpeg -f rawvideo -pix_fmt rgba -s 640x480 -r 60 -i file out.mp4
+ */
+int main(int argc, char* argv[])
+{
+	std::unique_ptr<scenario::Scenario> scene;
+	double fps = 60, duration = 10;
+	int width = 640, height = 480;
+	auto format = offscreen::Format::Png;
+	std::string path = "frames";
+	unsigned writers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	try
+	{
+		for (int i = 1; i + 1 < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--scenario")
+				scene = std::make_unique<scenario::Scenario>(scenario::Load(argv[++i]));
+			else if (arg == "--fps")
+				fps = std::atof(argv[++i]);
+			else if (arg == "--duration")
+				duration = std::atof(argv[++i]);
+			else if (arg == "--size")
+			{
+				if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+					throw std::runtime_error("bad size " + std::string(argv[i]));
+			}
+			else if (arg == "--png" || arg == "--raw")
+			{
+				format = arg == "--png" ? offscreen::Format::Png : offscreen::Format::Raw;
+				path = argv[++i];
+			}
+			else if (arg == "--writers")
+				writers = std::atoi(argv[++i]);
+			else
+				throw std::runtime_error("unknown option " + arg);
+		}
+		if (!(fps > 0) || !(duration >= 0) || width <= 0 || height <= 0)
+			throw std::runtime_error("fps, duration and size must be positive");
+		if (format == offscreen::Format::Png)
+			std::filesystem::create_directories(path);
+
+		Pendulum pend;
+		auto method = Method::RungeKutta;
+		double step = 1.0 / 240;
+		if (scene)
+		{
+			pend = std::move(scene->pend);
+			method = scene->solver;
+			step = scene->step;
+		}
+		else
+		{
+			pend.AddBall({0.5, 0.3, 50});
+			pend.AddBall({0.2, 0.4, 25});
+			pend.AddBall({0.2, 0.1, 20});
+			pend.AddBall({0.1, 0.2, 30});
+		}
+		auto solver = Solver(method);
+		Collider collider;
+
+		offscreen::Context context(width, height);
+		auto shd = Shader(vertexShader, pixelShader);
+		GLUquadricObj* quadObj = gluNewQuadric();
+		std::unique_ptr<GLUquadricObj, void (*)(GLUquadricObj*)> flusher(quadObj, gluDeleteQuadric);
+		gluQuadricDrawStyle(quadObj, GLU_FILL);
+		gluQuadricNormals(quadObj, GLU_SMOOTH);
+		glClearColor(0.3, 0.5, 0.7, 1);
+		glEnable(GL_DEPTH_TEST);
+
+		offscreen::Readback readback(width, height);
+		offscreen::Writer writer(format, path, width, height, writers);
+		auto sink = [&](unsigned char const* pixels, std::uint64_t frame) { writer.Push(pixels, frame); };
+
+		auto frames = static_cast<std::uint64_t>(duration * fps) + 1;
+		double time = 0, simSeconds = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (std::uint64_t f = 0; f < frames; f++)
+		{
+			auto simStart = std::chrono::steady_clock::now();
+			for (double target = f / fps; time + step / 2 <= target; time += step)
+			{
+				std::visit([&](auto const& s) { pend.Step(step, s); }, solver);
+				collider.Resolve(pend);
+			}
+			simSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - simStart).count();
+
+			draw::View(width, height, 3, 30 * mth::PI / 180, -1);
+			shd.Apply();
+			glUniform3f(shd.GetUniformLocation("idcol"), 1, 0.7, 0.7);
+			draw::Pend(pend, pend.ballCoords, quadObj);
+			Shader::ApplyDflt();
+			draw::Axes();
+			readback.Read(sink);
+		}
+		readback.Flush(sink);
+		writer.Close();
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cerr
+			<< frames << " frames " << width << "x" << height << " on " << context.Renderer() << " in " << seconds << " s, "
+			<< frames / seconds << " fps\n"
+			<< "simulation " << simSeconds << " s, waiting for writers " << writer.Waited() << " s" << std::endl;
+	}
+	catch (std::exception const& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "Jobs.h"
+
+/*
+ * Many small simulations as coroutine jobs on one executor.
+ * Step sizes differ per job, a coroutine per job reads its samples.
+ * usage: jobs-bench [jobs = 500] [threads = hardware] [duration = 5] [deadline ms = 0 (none)]
+ */
+namespace
+{
+	struct Reader
+	{
+		struct promise_type
+		{
+			Reader get_return_object() noexcept { return {}; }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept { std::terminate(); }
+		};
+	};
+
+	std::atomic<std::size_t> samples{0};
+
+	Reader Read(jobs::Job job)
+	{
+		while (auto s = co_await job.Next())
+			samples.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t count = argc > 1 ? std::atoi(argv[1]) : 500;
+	unsigned threads = argc > 2 ? std::atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+	double duration = argc > 3 ? std::atof(argv[3]) : 5;
+	int deadlineMs = argc > 4 ? std::atoi(argv[4]) : 0;
+
+	Pendulum pend;
+	pend.AddBall({0.5, 0.3, 50}, {0.1, 0, -0.5});
+	pend.AddBall({0.2, 0.4, 25});
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<jobs::Job> all;
+	{
+		jobs::Executor ex(threads);
+		for (std::size_t i = 0; i < count; i++)
+		{
+			jobs::Options opt;
+			opt.duration = duration;
+			opt.step = 1e-3 * (1 + i % 4);
+			opt.solver = static_cast<Method>(i % 3);
+			opt.reportEvery = 100;
+			opt.fullState = i % 2 == 0;
+			if (deadlineMs > 0)
+				opt.deadline = start + std::chrono::milliseconds(deadlineMs);
+			all.push_back(jobs::Simulate(ex, pend, opt));
+			Read(all.back());
+		}
+		for (auto const& j : all)
+			j.Wait();
+	}
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::size_t steps = 0, completed = 0, dropped = 0;
+	double least = duration, most = 0;
+	for (auto const& j : all)
+	{
+		auto const& r = j.Wait();
+		steps += r.steps;
+		completed += r.status == jobs::Status::Completed;
+		dropped += j.Dropped();
+		least = std::min(least, r.time);
+		most = std::max(most, r.time);
+	}
+	std::cout
+		<< count << " jobs on " << threads << " threads, " << completed << " completed in " << seconds << " s\n"
+		<< steps / seconds << " steps/s, " << samples << " samples, " << dropped << " dropped\n"
+		<< "simulated time per job " << least << " .. " << most << " s" << std::endl;
+}
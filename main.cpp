@@ -1,11 +1,20 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 
+#include "Collisions.h"
+#include "Commands.h"
+#include "Compare.h"
+#include "Density.h"
+#include "Draw.h"
 #include "pendulum.h"
+#include "Rewind.h"
+#include "Scenario.h"
+#include "SharedState.h"
 #include "shaders.h"
 #include "Shader.h"
 
@@ -21,6 +30,12 @@ namespace
 		double zang = 30 * mth::PI / 180;
 		double camrad = 3;
 		Pendulum* pend = nullptr;
+		Rewind<>* rewind = nullptr;
+		CommandQueue* commands = nullptr;
+		Comparison* compare = nullptr;
+		Collider* collider = nullptr;
+		// ensemble density instead of nothing, with --ensemble
+		bool cloud = true;
 
 		int selected = 0;
 		bool edit = false;
@@ -34,6 +49,7 @@ namespace
 		}
 
 		std::function<void()> editedCallback = EmpF;
+		std::function<void()> seekedCallback = EmpF;
 	};
 
 	WindowData& GetWData(GLFWwindow* ptr)
@@ -46,37 +62,6 @@ namespace
 		std::cerr << "Error : " << description << std::endl;
 	}
 
-	void DrawVertAt(vec const& v) noexcept
-	{
-		glVertex3f(v.X, v.Y, v.Z);
-	}
-
-	void DrawCS() noexcept
-	{
-		glDisable(GL_DEPTH_TEST);
-		glBegin(GL_LINES);
-			glLineWidth(1);
-			glColor3f(1, 0, 0);
-			glVertex3f(0, 0, 0);
-			glVertex3f(1, 0, 0);
-
-			glColor3f(0, 1, 0);
-			glVertex3f(0, 0, 0);
-			glVertex3f(0, 1, 0);
-
-			glColor3f(0, 0, 1);
-			glVertex3f(0, 0, 0);
-			glVertex3f(0, 0, 1);
-
-#if 0
-			glColor3f(1, 1, 1);
-			glVertex3f(0, 0, 0);
-			DrawVertAt(G);
-#endif
-		glEnd();
-		glEnable(GL_DEPTH_TEST);
-	}
-
 	void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) noexcept
 	{
 		auto& data = GetWData(window);
@@ -116,26 +101,52 @@ namespace
 			data.editorPos.Z += 6 * data.dt;
 		else if (key == GLFW_KEY_PAGE_DOWN && action != GLFW_RELEASE)
 			data.editorPos.Z -= 6 * data.dt;
-		else if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS)
+		// rewind
+		else if (key == GLFW_KEY_B && action != GLFW_RELEASE)
 		{
-			data.pend->PopBall();
-			data.selected %= data.pend->ballParams.size() + 1;
-			data.editedCallback();
+			data.pend->frozen = true;
+			data.rewind->SeekBy(*data.pend, -1);
+			data.seekedCallback();
 		}
-		else if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS)
+		else if (key == GLFW_KEY_N && action != GLFW_RELEASE)
 		{
 			data.pend->frozen = true;
-			double r;
-			std::cout << "r : ";
-			std::cin >> r;
-			double k;
-			std::cout << "k : ";
-			std::cin >> k;
-			double m;
-			std::cout << "m : ";
-			std::cin >> m;
-			data.pend->AddBall({r, m, k});
-			data.editedCallback();
+			data.rewind->SeekBy(*data.pend, 1);
+			data.seekedCallback();
+		}
+		else if (key == GLFW_KEY_C && action == GLFW_PRESS)
+			data.compare->Report(std::cout);
+		else if (key == GLFW_KEY_G && action == GLFW_PRESS)
+		{
+			// floor just under the lowest ball
+			auto& planes = data.collider->planes;
+			if (!planes.empty())
+				planes.clear();
+			else if (!data.pend->ballParams.empty())
+			{
+				double low = 0;
+				for (std::size_t i = 0; i < data.pend->ballParams.size(); i++)
+					low = std::min<double>(low, data.pend->ballCoords[i * 2].Z - data.pend->Radius(i));
+				planes.push_back({{0, 0, 1}, low - 0.05});
+			}
+		}
+		else if (key == GLFW_KEY_H && action == GLFW_PRESS)
+		{
+			// hang at rest, holding the ball being edited where it is
+			CommandQueue::Settle c;
+			if (data.edit && data.selected > 0)
+				c.held.push_back({std::size_t(data.selected - 1), data.pend->ballCoords[(data.selected - 1) * 2]});
+			data.commands->Push(std::move(c));
+		}
+		else if (key == GLFW_KEY_V && action == GLFW_PRESS)
+			data.cloud ^= 1;
+		else if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS)
+			data.commands->Push(CommandQueue::PopBall{});
+		else if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS)
+		{
+			// same as the last one, use console `add r k m` for custom parameters
+			auto bd = data.pend->ballParams.empty() ? Pendulum::BallData() : data.pend->ballParams.back();
+			data.commands->Push(CommandQueue::AddBall{bd});
 		}
 	}
 
@@ -147,8 +158,16 @@ namespace
 			<< "F -- toggle edit mode\n"
 			<< "arrows, page up/down -- move ball in edit mode\n"
 			<< "[ -- pop ball\n"
-			<< "] -- add ball (freezes)\n"
+			<< "] -- add ball like the last one\n"
 			<< "P -- pause\n"
+			<< "B/N -- rewind/forward by 1 second (freezes)\n"
+			<< "C -- print solver comparison (divergence, energy, phase)\n"
+			<< "G -- toggle floor under the pendulum\n"
+			<< "H -- settle to static equilibrium (holding the edited ball)\n"
+			<< "V -- toggle ensemble density (with --ensemble N [--spread metres] [--thermal kT])\n"
+			<< "\n"
+			<< "console commands (one per line, can be piped):\n"
+			<< "  add r k m | pop | set i r k m | g x y z | settle [i x y z]... | pause | resume\n"
 			<< "\n"
 			<< "Note that any editor operation sets all to RungeKutta current\n"
 			<< R"delim(
@@ -161,35 +180,42 @@ namespace
 			<< std::endl
 			;
 	}
-
-	void DrawPend(Pendulum const& pend, WindowData const& wnd, GLUquadricObj* quadObj)
-	{
-		glBegin(GL_LINE_STRIP);
-			glLineWidth(5);
-			glColor3f(0, 1, 1);
-			glVertex3f(0, 0, 0);
-			for (std::size_t i = 0; i < pend.ballParams.size(); i++)
-				DrawVertAt(pend.ballCoords[i * 2]);
-		glEnd();
-		for (std::size_t i = 0; i < pend.ballParams.size(); i++)
-		{
-			glPushMatrix();
-				if (wnd.selected == i + 1)
-					glColor3f(1, !wnd.edit, 0);
-				else
-					glColor3f(1, 1, 1);
-				auto tr = pend.ballCoords[i * 2];
-				glTranslated(tr.X, tr.Y, tr.Z);
-				gluSphere(quadObj, std::cbrt(pend.ballParams[i].m) / 10, 10, 10);
-			glPopMatrix();
-		}
-	}
 }
 
-int main()
+int main(int argc, char* argv[])
 {
 	ShowHelp();
 
+	// --publish /name -- share state with other processes, see SharedState.h
+	// --scenario file -- start from a scenario instead of the default chain, see Scenario.h
+	// --ensemble N, --spread metres -- N perturbed copies drawn as a density cloud, see Density.h
+	// --thermal kT -- ensemble members in a heat bath, see forces::Thermal
+	std::unique_ptr<shm::Publisher> publisher;
+	std::unique_ptr<scenario::Scenario> scene;
+	std::size_t members = 0;
+	double spread = 0.01, kT = 0;
+	for (int i = 1; i + 1 < argc; i++)
+		if (std::string(argv[i]) == "--publish")
+			publisher = std::make_unique<shm::Publisher>(argv[++i], 1024);
+		else if (std::string(argv[i]) == "--ensemble")
+			members = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::string(argv[i]) == "--spread")
+			spread = std::atof(argv[++i]);
+		else if (std::string(argv[i]) == "--thermal")
+			kT = std::atof(argv[++i]);
+		else if (std::string(argv[i]) == "--scenario")
+		{
+			try
+			{
+				scene = std::make_unique<scenario::Scenario>(scenario::Load(argv[++i]));
+			}
+			catch (std::exception const& e)
+			{
+				std::cerr << e.what() << std::endl;
+				return 1;
+			}
+		}
+
 	glfwSetErrorCallback(error_callback);
 	if (!glfwInit())
 		return 1;
@@ -213,17 +239,75 @@ int main()
 	auto shd = Shader(vertexShader, pixelShader);
 
 	Pendulum pend;
-	pend.AddBall({0.5, 0.3, 50});
-	pend.AddBall({0.2, 0.4, 25});
-	pend.AddBall({0.2, 0.1, 20});
-	pend.AddBall({0.1, 0.2, 30});
-	std::array<Pendulum, 2> other_pends;
-	other_pends.fill(pend);
+	if (scene)
+		pend = std::move(scene->pend);
+	else
+	{
+		pend.AddBall({0.5, 0.3, 50});
+		pend.AddBall({0.2, 0.4, 25});
+		pend.AddBall({0.2, 0.1, 20});
+		pend.AddBall({0.1, 0.2, 30});
+	}
+	// green and blue pendulums, RK4 is not drawn but is the reference C compares both to
+	Comparison compare({Comparison::Method::Euler, Comparison::Method::Midpoint, Comparison::Method::RungeKutta});
+	compare.Reset(pend);
+
+	// balls bounce off each other and the floor (G)
+	Collider collider;
+	compare.afterStep = [&](Pendulum const& params, Comparison::State& s) { collider.Resolve(params, s); };
+
+	Rewind<> rewind(scene ? scene->step : 1.0 / 240);
+	// every fixed step is published, not only the last of a frame; comparison lanes take
+	// the same fixed steps, so they follow the red pendulum rather than the frame rate
+	// (seek replays step them too, seekedCallback restarts them after)
+	rewind.afterStep = [&](Pendulum& p) {
+		collider.Resolve(p);
+		compare.Step(rewind.step);
+		if (publisher)
+			publisher->Publish(p, rewind.Time());
+	};
+	rewind.Reset(pend);
+
+	std::unique_ptr<Ensemble> ensemble;
+	Density density;
+	auto resetEnsemble = [&]() {
+		if (!ensemble)
+			return;
+		ensemble->Reset(pend, members, spread);
+		density.SetBox(Density::Around(pend));
+	};
+	if (members > 0)
+	{
+		ensemble = std::make_unique<Ensemble>(scene ? scene->step : 1.0 / 240);
+		if (kT > 0)
+		{
+			ensemble->thermal.emplace();
+			ensemble->thermal->kT = kT;
+		}
+		resetEnsemble();
+	}
+
+	CommandQueue commands;
+	commands.Listen();
 
 	WindowData wnd;
 	wnd.pend = &pend;
+	wnd.rewind = &rewind;
+	wnd.commands = &commands;
+	wnd.compare = &compare;
+	wnd.collider = &collider;
 	wnd.editedCallback = [&]() {
-		other_pends.fill(pend);
+		compare.Reset(pend);
+		rewind.Reset(pend);
+		resetEnsemble();
+		if (publisher)
+			publisher->Publish(pend, rewind.Time());
+	};
+	wnd.seekedCallback = [&]() {
+		compare.SetState(pend.ballCoords);
+		resetEnsemble();
+		if (publisher)
+			publisher->Publish(pend, rewind.Time());
 	};
 	glfwSetWindowUserPointer(window, reinterpret_cast<void*>(&wnd));
 	glfwSetKeyCallback(window, key_callback);
@@ -239,12 +323,19 @@ int main()
 	auto prev = std::chrono::system_clock::now();
 	while (!glfwWindowShouldClose(window))
 	{
+		audit::NextUpdate();
 		auto now = std::chrono::system_clock::now();
 		{
 			wnd.dt = std::chrono::duration<double>(now - prev).count();
 			prev = std::move(now);
 		}
 
+		if (commands.Apply(pend))
+		{
+			wnd.selected %= pend.ballParams.size() + 1;
+			wnd.editedCallback();
+		}
+
 		vec* posprev = nullptr;
 		vec* savedV = nullptr;
 		vec posprevsaved;
@@ -254,31 +345,25 @@ int main()
 			posprev = &pend.ballCoords[m1 * 2];
 			posprevsaved = *posprev;
 			savedV = &pend.ballCoords[m1 * 2 + 1];
-			other_pends.fill(pend);
+			compare.SetState(pend.ballCoords);
 		}
-		pend.Update(now);
-		other_pends[0].Update(now, EulerSolver());
-		other_pends[1].Update(now, MidpointSolver());
+		if (!pend.frozen)
+			rewind.Advance(pend, wnd.dt);
+		if (ensemble && !pend.frozen)
+			ensemble->Advance(wnd.dt);
 		if (posprev != nullptr)
 		{
 			*posprev = posprevsaved + wnd.GetEditorPos();
 			*savedV = vec(0);
+			rewind.Reset(pend);
+			if (publisher)
+				publisher->Publish(pend, rewind.Time());
 		}
 
 		int width, height;
 
 		glfwGetFramebufferSize(window, &width, &height);
-		float ratio = height / (float)width;
-
-		// glFrustum(float left, float right, float bottom, float top, float near, float far);
-		glViewport(0, 0, width, height);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		glLoadIdentity();
-		glFrustum(-0.1, 0.1, -0.1 * ratio, 0.1 * ratio, 0.1, 1000);
-		gluLookAt(wnd.camrad * sin(wnd.zang), wnd.camrad * cos(wnd.zang), wnd.posz + 1,
-		          0, 0, wnd.posz,
-		          0, 0, 1);
+		draw::View(width, height, wnd.camrad, wnd.zang, wnd.posz);
 
 		// draw content
 		{
@@ -286,19 +371,26 @@ int main()
 			auto ind = shd.GetUniformLocation("idcol");
 
 			glUniform3f(ind, 1, 0.7, 0.7);
-			DrawPend(pend, wnd, quadObj);
+			draw::Pend(pend, pend.ballCoords, quadObj, wnd.selected, wnd.edit);
 			if (!wnd.edit || wnd.selected == 0)
 			{
 				glUniform3f(ind, 0.7, 1, 0.7);
-				DrawPend(other_pends[0], wnd, quadObj);
+				draw::Pend(compare.Params(), compare.StateOf(0), quadObj, wnd.selected, wnd.edit);
 				glUniform3f(ind, 0.7, 0.7, 1);
-				DrawPend(other_pends[1], wnd, quadObj);
+				draw::Pend(compare.Params(), compare.StateOf(1), quadObj, wnd.selected, wnd.edit);
 			}
 
 			Shader::ApplyDflt();
 		}
 
-		DrawCS();
+		if (ensemble && wnd.cloud)
+		{
+			density.Accumulate(*ensemble);
+			density.Cloud();
+			draw::Cloud(density.Vertices(), density.Colors());
+		}
+
+		draw::Axes();
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
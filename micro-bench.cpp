@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Equilibrium.h"
+#include "Forces.h"
+#include "pendulum.h"
+#include "mth/philox.h"
+
+/*
+ * Per-kernel timings of the math layer: mth::vec operations, Solvers.h valarray
+ * operators, philox batches, solver steps and static equilibrium solves on chains of 2 to 128 balls.
+ * Every kernel is calibrated to ~1 ms samples, warmed up, then sampled `reps` times.
+ * Hardware counters come from perf_event when the kernel allows it.
+ * usage: micro-bench [--filter text] [--reps n] [--save file] [--compare file] [--threshold 0.05]
+ * --compare exits with 1 when some kernel is significantly slower than the baseline.
+ */
+
+namespace
+{
+	template<typename T>
+	void Keep(T const& v) noexcept
+	{
+		asm volatile("" : : "g"(&v) : "memory");
+	}
+
+	struct Kernel
+	{
+		std::string name;
+		// runs `iters` operations
+		std::function<void(std::size_t iters)> run;
+		// called before every sample, outside of timing
+		std::function<void()> reset = nullptr;
+	};
+
+	struct Summary
+	{
+		std::size_t n = 0;
+		double mean = 0, stddev = 0, median = 0, min = 0;
+
+		static Summary Of(std::vector<double> v)
+		{
+			Summary s;
+			s.n = v.size();
+			if (v.empty())
+				return s;
+			std::sort(v.begin(), v.end());
+			s.min = v.front();
+			s.median = v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+			for (auto x : v)
+				s.mean += x;
+			s.mean /= v.size();
+			for (auto x : v)
+				s.stddev += (x - s.mean) * (x - s.mean);
+			s.stddev = v.size() > 1 ? std::sqrt(s.stddev / (v.size() - 1)) : 0;
+			return s;
+		}
+	};
+
+	class Counters
+	{
+	public:
+		static constexpr std::size_t count = 4;
+		static constexpr char const* names[count] = {"cycles", "instr", "cache-miss", "branch-miss"};
+		using Values = std::array<double, count>;
+
+	private:
+#ifdef __linux__
+		// fd per counter, -1 if the event could not be opened
+		std::array<int, count> fds;
+		// position of every open counter in a group read
+		std::array<int, count> slot;
+		int opened = 0;
+
+		static int Open(std::uint64_t config, int group) noexcept
+		{
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = config;
+			attr.disabled = group == -1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+			return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+		}
+#endif
+
+	public:
+		Counters() noexcept
+		{
+#ifdef __linux__
+			std::uint64_t configs[count] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+					PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+			fds.fill(-1);
+			slot.fill(-1);
+			for (std::size_t i = 0; i < count; i++)
+			{
+				fds[i] = Open(configs[i], opened == 0 ? -1 : fds[0]);
+				if (fds[i] >= 0)
+					slot[i] = opened++;
+				else if (i == 0)
+					return;
+			}
+#endif
+		}
+		~Counters()
+		{
+#ifdef __linux__
+			for (auto fd : fds)
+				if (fd >= 0)
+					close(fd);
+#endif
+		}
+		Counters(Counters const&) = delete;
+		Counters& operator=(Counters const&) = delete;
+
+		bool Available() const noexcept
+		{
+#ifdef __linux__
+			return opened > 0;
+#else
+			return false;
+#endif
+		}
+
+		void Start() noexcept
+		{
+#ifdef __linux__
+			if (!Available())
+				return;
+			ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+		}
+
+		// NaN for counters that are not available
+		Values Stop() noexcept
+		{
+			Values res;
+			res.fill(NAN);
+#ifdef __linux__
+			if (!Available())
+				return res;
+			ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			std::uint64_t buf[1 + count];
+			if (read(fds[0], buf, sizeof(buf)) < static_cast<ssize_t>(sizeof(std::uint64_t)))
+				return res;
+			for (std::size_t i = 0; i < count; i++)
+				if (slot[i] >= 0 && static_cast<std::uint64_t>(slot[i]) < buf[0])
+					res[i] = static_cast<double>(buf[1 + slot[i]]);
+#endif
+			return res;
+		}
+	};
+
+	struct Result
+	{
+		std::string name;
+		// nanoseconds per operation of every sample
+		std::vector<double> samples;
+		Summary time;
+		// per operation, medians over samples
+		Counters::Values counters;
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	double Seconds(Kernel const& k, std::size_t iters)
+	{
+		if (k.reset)
+			k.reset();
+		auto start = Clock::now();
+		k.run(iters);
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	Result Measure(Kernel const& k, std::size_t reps, Counters& counters)
+	{
+		constexpr double sampleSeconds = 1e-3, warmupSeconds = 0.05;
+		// grow until one sample is long enough to time
+		std::size_t iters = 1;
+		while (Seconds(k, iters) < sampleSeconds && iters < (std::size_t(1) << 40))
+			iters *= 2;
+		for (auto start = Clock::now(); Clock::now() - start < std::chrono::duration<double>(warmupSeconds);)
+			Seconds(k, iters);
+
+		Result res = {};
+		res.name = k.name;
+		std::vector<std::vector<double>> perOp(Counters::count);
+		for (std::size_t r = 0; r < reps; r++)
+		{
+			if (k.reset)
+				k.reset();
+			counters.Start();
+			auto start = Clock::now();
+			k.run(iters);
+			auto end = Clock::now();
+			auto c = counters.Stop();
+			res.samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iters);
+			for (std::size_t i = 0; i < Counters::count; i++)
+				perOp[i].push_back(c[i] / iters);
+		}
+		res.time = Summary::Of(res.samples);
+		for (std::size_t i = 0; i < Counters::count; i++)
+			res.counters[i] = Summary::Of(perOp[i]).median;
+		return res;
+	}
+
+	/*
+	 * Welch's t between baseline and current sample means.
+	 * A regression needs both t above 3 (well past 99% for tens of samples)
+	 * and a median slowdown over the threshold, so noise alone does not flag.
+	 */
+	bool Regressed(Summary const& base, Summary const& cur, double threshold, double& t)
+	{
+		auto se = std::sqrt(base.stddev * base.stddev / base.n + cur.stddev * cur.stddev / cur.n);
+		t = se > 0 ? (cur.mean - base.mean) / se : 0;
+		return t > 3 && cur.median > base.median * (1 + threshold);
+	}
+
+	std::map<std::string, Summary> LoadBaseline(std::string const& path)
+	{
+		std::map<std::string, Summary> res;
+		std::ifstream in(path);
+		std::string line;
+		while (std::getline(in, line))
+		{
+			std::istringstream ls(line);
+			std::string name;
+			Summary s;
+			if (ls >> name >> s.n >> s.mean >> s.stddev >> s.median >> s.min)
+				res[name] = s;
+		}
+		return res;
+	}
+
+	void SaveBaseline(std::string const& path, std::vector<Result> const& results)
+	{
+		std::ofstream out(path);
+		out.precision(17);
+		for (auto const& r : results)
+			out << r.name << ' ' << r.time.n << ' ' << r.time.mean << ' ' << r.time.stddev << ' ' << r.time.median << ' ' << r.time.min << '\n';
+	}
+
+	// data shared by the vec kernels, large enough to defeat constant folding, small enough for L1
+	constexpr std::size_t vecCount = 256;
+	std::vector<vec> va, vb, vc;
+	double scale = 1.0001;
+
+	void AddVecKernels(std::vector<Kernel>& ks)
+	{
+		va.resize(vecCount);
+		vb.resize(vecCount);
+		vc.resize(vecCount);
+		for (std::size_t i = 0; i < vecCount; i++)
+		{
+			va[i] = vec(mth::Rnd1(), mth::Rnd1(), mth::Rnd1());
+			vb[i] = vec(mth::Rnd1(), mth::Rnd1(), mth::Rnd1());
+		}
+		// one operation is one vector of the array
+		auto loop = [](auto body) {
+			return [body](std::size_t iters) {
+				for (std::size_t i = 0; i < iters; i++)
+					body(i % vecCount);
+				Keep(vc);
+			};
+		};
+		ks.push_back({"vec.add", loop([](std::size_t i) { vc[i] = va[i] + vb[i]; })});
+		ks.push_back({"vec.axpy", loop([](std::size_t i) { vc[i] = va[i] * scale + vb[i]; })});
+		ks.push_back({"vec.inplace", loop([](std::size_t i) {
+									 vc[i] += va[i];
+									 vc[i] *= 0.5;
+								 }),
+				[] { std::fill(vc.begin(), vc.end(), vec(0)); }});
+		ks.push_back({"vec.dot", loop([](std::size_t i) { vc[i].X = va[i] & vb[i]; })});
+		ks.push_back({"vec.cross", loop([](std::size_t i) { vc[i] = va[i] % vb[i]; })});
+		ks.push_back({"vec.len", loop([](std::size_t i) { vc[i].X = va[i].Len(); })});
+		ks.push_back({"vec.normalize", loop([](std::size_t i) { vc[i] = va[i].Normalizing(); })});
+	}
+
+	// one operation is one batch of 4096 words, uniforms or normals
+	void AddRandomKernels(std::vector<Kernel>& ks)
+	{
+		constexpr std::size_t batch = 4096;
+		auto words = std::make_shared<std::vector<std::uint32_t>>(batch);
+		auto numbers = std::make_shared<std::vector<double>>(batch / 2);
+		mth::philox rng(1);
+		ks.push_back({"philox.fill",
+				[=](std::size_t iters) {
+					for (std::size_t i = 0; i < iters; i++)
+						rng.Fill(0, i * batch / 4, words->data(), batch);
+					Keep(*words);
+				}});
+		ks.push_back({"philox.uniform",
+				[=](std::size_t iters) {
+					for (std::size_t i = 0; i < iters; i++)
+						rng.Uniform(0, i * batch / 4, numbers->data(), numbers->size());
+					Keep(*numbers);
+				}});
+		ks.push_back({"philox.normal",
+				[=](std::size_t iters) {
+					for (std::size_t i = 0; i < iters; i++)
+						rng.Normal(0, i * batch / 4, numbers->data(), numbers->size());
+					Keep(*numbers);
+				}});
+	}
+
+	void AddValarrayKernels(std::vector<Kernel>& ks)
+	{
+		for (std::size_t n : {8, 64, 512})
+		{
+			auto a = std::make_shared<std::valarray<vec>>(vec(1, 2, 3), n);
+			auto b = std::make_shared<std::valarray<vec>>(vec(0.5, -1, 2), n);
+			auto sn = std::to_string(n);
+			// one operation is one whole array
+			ks.push_back({"valarray.scale/" + sn, [=](std::size_t iters) {
+							  for (std::size_t i = 0; i < iters; i++)
+							  {
+								  *a *= scale;
+								  *a /= scale;
+							  }
+							  Keep(*a);
+						  }});
+			ks.push_back({"valarray.mul/" + sn, [=](std::size_t iters) {
+							  for (std::size_t i = 0; i < iters; i++)
+							  {
+								  auto c = *a * scale;
+								  Keep(c);
+							  }
+						  }});
+			ks.push_back({"valarray.add/" + sn, [=](std::size_t iters) {
+							  for (std::size_t i = 0; i < iters; i++)
+							  {
+								  std::valarray<vec> c = *a + *b;
+								  Keep(c);
+							  }
+						  }});
+		}
+	}
+
+	// chain with balls hanging slightly off vertical, restored before every sample
+	template<typename S>
+	void AddSolverKernel(std::vector<Kernel>& ks, std::string const& name, std::size_t balls)
+	{
+		auto pend = std::make_shared<Pendulum>();
+		for (std::size_t i = 0; i < balls; i++)
+			pend->AddBall({0.5, 0.3, 50}, {0.05 * (i % 3), 0.02 * (i % 2), -0.5 * (i + 1)});
+		auto start = std::make_shared<std::valarray<vec>>(pend->ballCoords);
+		// one operation is one step
+		ks.push_back({name + "/" + std::to_string(balls),
+				[=](std::size_t iters) {
+					for (std::size_t i = 0; i < iters; i++)
+						pend->Step(1e-3, S());
+					Keep(pend->ballCoords);
+				},
+				[=] { pend->ballCoords = *start; }});
+	}
+
+	// same chain under a force preset, chosen at runtime as the viewer would
+	void AddForcesKernel(std::vector<Kernel>& ks, std::string const& preset, std::size_t balls)
+	{
+		auto pend = std::make_shared<Pendulum>();
+		for (std::size_t i = 0; i < balls; i++)
+			pend->AddBall({0.5, 0.3, 50}, {0.05 * (i % 3), 0.02 * (i % 2), -0.5 * (i + 1)});
+		auto start = std::make_shared<std::valarray<vec>>(pend->ballCoords);
+		auto terms = std::make_shared<forces::Preset>(forces::MakePreset(preset));
+		ks.push_back({"step.rk4." + preset + "/" + std::to_string(balls),
+				[=](std::size_t iters) {
+					for (std::size_t i = 0; i < iters; i++)
+						forces::Step(*pend, *terms, i * 1e-3, 1e-3);
+					Keep(pend->ballCoords);
+				},
+				[=] { pend->ballCoords = *start; }});
+	}
+
+	// static equilibrium with the last ball held off to the side, one operation is one solve
+	void AddEquilibriumKernel(std::vector<Kernel>& ks, std::size_t balls)
+	{
+		auto pend = std::make_shared<Pendulum>();
+		for (std::size_t i = 0; i < balls; i++)
+			pend->AddBall({0.5, 0.3, 50});
+		auto solver = std::make_shared<equilibrium::Solver>();
+		std::vector<equilibrium::Fixed> held = {{balls - 1, {0.2 * balls, 0, -0.4 * balls}}};
+		ks.push_back({"equilibrium/" + std::to_string(balls),
+				[=](std::size_t iters) {
+					for (std::size_t i = 0; i < iters; i++)
+						solver->Solve(*pend, held);
+					Keep(pend->ballCoords);
+				},
+				[] {}});
+	}
+
+	void AddSolverKernels(std::vector<Kernel>& ks)
+	{
+		for (std::size_t n : {2, 8, 32, 128})
+		{
+			AddSolverKernel<EulerSolver>(ks, "step.euler", n);
+			AddSolverKernel<MidpointSolver>(ks, "step.midpoint", n);
+			AddSolverKernel<RungeKuttaSolver>(ks, "step.rk4", n);
+			AddForcesKernel(ks, "damped", n);
+			AddForcesKernel(ks, "driven-air", n);
+			AddEquilibriumKernel(ks, n);
+		}
+	}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	std::string filter, savePath, comparePath;
+	std::size_t reps = 30;
+	double threshold = 0.05;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		auto next = [&]() -> std::string {
+			if (i + 1 >= argc)
+			{
+				std::cerr << arg << " needs a value" << std::endl;
+				std::exit(2);
+			}
+			return argv[++i];
+		};
+		if (arg == "--filter")
+			filter = next();
+		else if (arg == "--reps")
+			reps = std::max(2, std::atoi(next().c_str()));
+		else if (arg == "--save")
+			savePath = next();
+		else if (arg == "--compare")
+			comparePath = next();
+		else if (arg == "--threshold")
+			threshold = std::atof(next().c_str());
+		else
+		{
+			std::cerr << "usage: micro-bench [--filter text] [--reps n] [--save file] [--compare file] [--threshold 0.05]" << std::endl;
+			return 2;
+		}
+	}
+
+	std::vector<Kernel> kernels;
+	AddVecKernels(kernels);
+	AddValarrayKernels(kernels);
+	AddRandomKernels(kernels);
+	AddSolverKernels(kernels);
+
+	Counters counters;
+	if (!counters.Available())
+		std::cout << "perf_event counters are not available\n";
+	auto baseline = comparePath.empty() ? std::map<std::string, Summary>() : LoadBaseline(comparePath);
+	if (!comparePath.empty() && baseline.empty())
+		std::cerr << "no baseline in " << comparePath << std::endl;
+
+	std::cout << std::left << std::setw(22) << "kernel" << std::right << std::setw(12) << "median ns" << std::setw(12) << "mean ns"
+			  << std::setw(10) << "sd %" << std::setw(12) << "min ns";
+	if (counters.Available())
+		for (auto name : Counters::names)
+			std::cout << std::setw(13) << name;
+	if (!baseline.empty())
+		std::cout << std::setw(10) << "vs base" << std::setw(8) << "t";
+	std::cout << '\n';
+
+	std::vector<Result> results;
+	int regressions = 0;
+	for (auto const& k : kernels)
+	{
+		if (!filter.empty() && k.name.find(filter) == std::string::npos)
+			continue;
+		auto const& r = results.emplace_back(Measure(k, reps, counters));
+		std::cout << std::left << std::setw(22) << r.name << std::right << std::fixed << std::setprecision(2)
+				  << std::setw(12) << r.time.median << std::setw(12) << r.time.mean
+				  << std::setw(10) << 100 * r.time.stddev / r.time.mean << std::setw(12) << r.time.min;
+		if (counters.Available())
+			for (auto c : r.counters)
+				std::cout << std::setw(13) << c;
+		if (auto it = baseline.find(r.name); it != baseline.end())
+		{
+			double t;
+			bool bad = Regressed(it->second, r.time, threshold, t);
+			regressions += bad;
+			std::cout << std::showpos << std::setw(9) << 100 * (r.time.median / it->second.median - 1) << '%'
+					  << std::setw(8) << std::setprecision(1) << t << std::noshowpos << (bad ? "  REGRESSION" : "");
+		}
+		std::cout << std::defaultfloat << std::endl;
+	}
+
+	if (!savePath.empty())
+		SaveBaseline(savePath, results);
+	if (!baseline.empty())
+		std::cout << regressions << " significant regressions" << std::endl;
+	return regressions ? 1 : 0;
+}
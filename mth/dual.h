@@ -0,0 +1,130 @@
+#pragma once
+
+#include "mthdef.h"
+
+namespace mth
+{
+	/*
+	 * Forward mode automatic differentiation number:
+	 * value V and its partial derivatives D by N independent variables.
+	 * Comparisons only look at values.
+	 */
+	template<class type, int N>
+	class dual
+	{
+	public:
+		type V;
+		type D[N];
+
+		dual(type v = 0) noexcept
+		: V(v)
+		{
+			for (int i = 0; i < N; i++)
+				D[i] = 0;
+		}
+		template<class type2, class = std::enable_if_t<std::is_arithmetic_v<type2>>>
+		dual(type2 v) noexcept
+		: dual(type(v))
+		{}
+		// value with derivative 1 by variable i (i out of [0, N) makes a constant)
+		static dual Variable(type v, int i) noexcept
+		{
+			dual r(v);
+			if (i >= 0 && i < N)
+				r.D[i] = 1;
+			return r;
+		}
+
+		dual& operator+=(dual const& b) noexcept
+		{
+			V += b.V;
+			for (int i = 0; i < N; i++)
+				D[i] += b.D[i];
+			return *this;
+		}
+		dual& operator-=(dual const& b) noexcept
+		{
+			V -= b.V;
+			for (int i = 0; i < N; i++)
+				D[i] -= b.D[i];
+			return *this;
+		}
+		dual& operator*=(dual const& b) noexcept
+		{
+			for (int i = 0; i < N; i++)
+				D[i] = D[i] * b.V + V * b.D[i];
+			V *= b.V;
+			return *this;
+		}
+		dual& operator/=(dual const& b) noexcept
+		{
+			auto inv = 1 / b.V;
+			V *= inv;
+			for (int i = 0; i < N; i++)
+				D[i] = (D[i] - V * b.D[i]) * inv;
+			return *this;
+		}
+		dual& operator+=(type b) noexcept
+		{
+			V += b;
+			return *this;
+		}
+		dual& operator-=(type b) noexcept
+		{
+			V -= b;
+			return *this;
+		}
+		dual& operator*=(type b) noexcept
+		{
+			V *= b;
+			for (int i = 0; i < N; i++)
+				D[i] *= b;
+			return *this;
+		}
+		dual& operator/=(type b) noexcept { return *this *= 1 / b; }
+
+		dual operator-() const noexcept
+		{
+			dual r = *this;
+			r.V = -V;
+			for (int i = 0; i < N; i++)
+				r.D[i] = -D[i];
+			return r;
+		}
+
+		friend dual operator+(dual a, dual const& b) noexcept { return a += b; }
+		friend dual operator-(dual a, dual const& b) noexcept { return a -= b; }
+		friend dual operator*(dual a, dual const& b) noexcept { return a *= b; }
+		friend dual operator/(dual a, dual const& b) noexcept { return a /= b; }
+		friend dual operator+(dual a, type b) noexcept { return a += b; }
+		friend dual operator-(dual a, type b) noexcept { return a -= b; }
+		friend dual operator*(dual a, type b) noexcept { return a *= b; }
+		friend dual operator/(dual a, type b) noexcept { return a /= b; }
+		friend dual operator+(type a, dual b) noexcept { return b += a; }
+		friend dual operator-(type a, dual const& b) noexcept { return -b + a; }
+		friend dual operator*(type a, dual b) noexcept { return b *= a; }
+		friend dual operator/(type a, dual const& b) noexcept { return dual(a) / b; }
+
+		friend bool operator==(dual const& a, dual const& b) noexcept { return a.V == b.V; }
+		friend bool operator!=(dual const& a, dual const& b) noexcept { return a.V != b.V; }
+		friend bool operator<(dual const& a, dual const& b) noexcept { return a.V < b.V; }
+		friend bool operator>(dual const& a, dual const& b) noexcept { return a.V > b.V; }
+		friend bool operator<=(dual const& a, dual const& b) noexcept { return a.V <= b.V; }
+		friend bool operator>=(dual const& a, dual const& b) noexcept { return a.V >= b.V; }
+		friend bool operator==(dual const& a, type b) noexcept { return a.V == b; }
+		friend bool operator!=(dual const& a, type b) noexcept { return a.V != b; }
+		friend bool operator<(dual const& a, type b) noexcept { return a.V < b; }
+		friend bool operator>(dual const& a, type b) noexcept { return a.V > b; }
+
+		friend dual sqrt(dual a) noexcept
+		{
+			auto s = std::sqrt(a.V);
+			auto ds = 1 / (2 * s);
+			a.V = s;
+			for (int i = 0; i < N; i++)
+				a.D[i] *= ds;
+			return a;
+		}
+		friend dual abs(dual const& a) noexcept { return a.V < 0 ? -a : a; }
+	};
+} // namespace mth
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <bit>
 #include <cassert>
+#include <cstdint>
 #include <type_traits>
 #include <cmath>
 #include <utility>
@@ -76,6 +78,11 @@ namespace mth
 	{
 		return X * X * X;
 	} 
+	// by the exponent bits, which -ffast-math does not assume away as it does std::isfinite
+	inline bool IsFinite(double X) noexcept
+	{
+		return (std::bit_cast<std::uint64_t>(X) & 0x7FF0'0000'0000'0000) != 0x7FF0'0000'0000'0000;
+	}
 } // namespace mth
 
 /* END OF 'tvz_mthdef.h' FILE */
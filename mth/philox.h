@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace mth
+{
+	/*
+	 * Philox4x32-10 counter-based generator (Salmon et al., Random123).
+	 * A 128-bit counter is encrypted under a 64-bit key into four random words, so any
+	 * position of any stream is computed directly: no state is carried between calls
+	 * and the numbers of a stream do not depend on who draws them or in what order.
+	 * Here the counter is (position, stream), 64 bits each, the key is the seed.
+	 * Batches work on `lanes` counters at once in separate arrays, which compilers
+	 * turn into vector multiplies (pmuludq and wider) without intrinsics.
+	 */
+	class philox
+	{
+	public:
+		using block = std::array<std::uint32_t, 4>;
+		static constexpr std::size_t lanes = 8;
+
+	private:
+		static constexpr std::uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+		static constexpr std::uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+		std::uint32_t k0, k1;
+
+		// lanes counters of stream from position encrypted in place, word w of lane l in c[w][l]
+		void Rounds(std::uint64_t stream, std::uint64_t position, std::uint32_t (&c)[4][lanes]) const noexcept
+		{
+			for (std::size_t l = 0; l < lanes; l++)
+			{
+				auto p = position + l;
+				c[0][l] = std::uint32_t(p);
+				c[1][l] = std::uint32_t(p >> 32);
+				c[2][l] = std::uint32_t(stream);
+				c[3][l] = std::uint32_t(stream >> 32);
+			}
+			auto a = k0, b = k1;
+			for (int r = 0; r < 10; r++, a += W0, b += W1)
+				for (std::size_t l = 0; l < lanes; l++)
+				{
+					auto p0 = std::uint64_t(M0) * c[0][l];
+					auto p1 = std::uint64_t(M1) * c[2][l];
+					auto n0 = std::uint32_t(p1 >> 32) ^ c[1][l] ^ a;
+					auto n2 = std::uint32_t(p0 >> 32) ^ c[3][l] ^ b;
+					c[1][l] = std::uint32_t(p1);
+					c[3][l] = std::uint32_t(p0);
+					c[0][l] = n0;
+					c[2][l] = n2;
+				}
+		}
+
+		// the same, output block by block
+		void Blocks(std::uint64_t stream, std::uint64_t position, std::uint32_t* out) const noexcept
+		{
+			std::uint32_t c[4][lanes];
+			Rounds(stream, position, c);
+			for (std::size_t l = 0; l < lanes; l++)
+			{
+				out[l * 4] = c[0][l];
+				out[l * 4 + 1] = c[1][l];
+				out[l * 4 + 2] = c[2][l];
+				out[l * 4 + 3] = c[3][l];
+			}
+		}
+
+		// mantissa bits under the exponent of 1 make [1, 2) without an integer conversion
+		static double Unit(std::uint32_t lo, std::uint32_t hi) noexcept
+		{
+			return std::bit_cast<double>(0x3FF0'0000'0000'0000 | (std::uint64_t(hi) << 32 | lo) >> 12) - 1;
+		}
+
+	public:
+		explicit philox(std::uint64_t seed = 0) noexcept
+		: k0(std::uint32_t(seed)), k1(std::uint32_t(seed >> 32))
+		{}
+
+		// the raw generator: counter {c0, c1, c2, c3} under key {k0, k1}
+		static block Encrypt(block c, std::uint32_t k0, std::uint32_t k1) noexcept
+		{
+			for (int r = 0; r < 10; r++, k0 += W0, k1 += W1)
+			{
+				auto p0 = std::uint64_t(M0) * c[0];
+				auto p1 = std::uint64_t(M1) * c[2];
+				c = {std::uint32_t(p1 >> 32) ^ c[1] ^ k0, std::uint32_t(p1), std::uint32_t(p0 >> 32) ^ c[3] ^ k1, std::uint32_t(p0)};
+			}
+			return c;
+		}
+
+		// block at position of stream
+		block operator()(std::uint64_t stream, std::uint64_t position) const noexcept
+		{
+			return Encrypt({std::uint32_t(position), std::uint32_t(position >> 32), std::uint32_t(stream), std::uint32_t(stream >> 32)}, k0, k1);
+		}
+
+		// n words of stream starting at block position, word i is word i % 4 of block position + i / 4
+		void Fill(std::uint64_t stream, std::uint64_t position, std::uint32_t* out, std::size_t n) const noexcept
+		{
+			std::size_t i = 0;
+			for (; i + lanes * 4 <= n; i += lanes * 4, position += lanes)
+				Blocks(stream, position, out + i);
+			if (i == n)
+				return;
+			std::uint32_t tail[lanes * 4];
+			Blocks(stream, position, tail);
+			for (std::size_t j = 0; j < n - i; j++)
+				out[i + j] = tail[j];
+		}
+
+		// uniform in [0, 1) from 52 bits of a word pair, double i from block position + i / 2
+		void Uniform(std::uint64_t stream, std::uint64_t position, double* out, std::size_t n) const noexcept
+		{
+			std::size_t i = 0;
+			for (; i + lanes * 2 <= n; i += lanes * 2, position += lanes)
+			{
+				std::uint32_t c[4][lanes];
+				Rounds(stream, position, c);
+				for (std::size_t l = 0; l < lanes; l++)
+				{
+					out[i + l * 2] = Unit(c[0][l], c[1][l]);
+					out[i + l * 2 + 1] = Unit(c[2][l], c[3][l]);
+				}
+			}
+			if (i == n)
+				return;
+			std::uint32_t tail[lanes * 4];
+			Blocks(stream, position, tail);
+			for (std::size_t j = 0; j < n - i; j++)
+				out[i + j] = Unit(tail[j * 2], tail[j * 2 + 1]);
+		}
+
+		// standard normal by Box-Muller, normal i from block position + i / 2 like Uniform
+		void Normal(std::uint64_t stream, std::uint64_t position, double* out, std::size_t n) const noexcept
+		{
+			constexpr double tau = 2 * 3.14159265358979323846;
+			auto pair = [tau](double u0, double u1, double* to) {
+				auto r = std::sqrt(-2 * std::log(1 - u0));
+				to[0] = r * std::cos(tau * u1);
+				to[1] = r * std::sin(tau * u1);
+			};
+			auto even = n & ~std::size_t(1);
+			Uniform(stream, position, out, even);
+			for (std::size_t i = 0; i < even; i += 2)
+				pair(out[i], out[i + 1], out + i);
+			if (n & 1)
+			{
+				double last[2];
+				Uniform(stream, position + even / 2, last, 2);
+				pair(last[0], last[1], last);
+				out[n - 1] = last[0];
+			}
+		}
+	};
+} // namespace mth
@@ -0,0 +1,141 @@
+#pragma once
+
+#if defined(MTH_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <immintrin.h>
+#define MTH_SIMD_ENABLED 1
+#endif
+
+namespace mth
+{
+	/*
+	 * Lane operations behind vec<type>. Enabled types keep vec padded to 4 lanes
+	 * (X, Y, Z, pad) and 16-byte aligned; lane 3 is zero on construction and never
+	 * reaches a horizontal result. 256-bit loads are unaligned because valarray
+	 * storage is only malloc-aligned.
+	 * Build with MTH_SIMD defined to turn it on.
+	 */
+	template<class type>
+	struct simd
+	{
+		static constexpr bool enabled = false;
+		struct reg
+		{};
+	};
+
+#ifdef MTH_SIMD_ENABLED
+	template<>
+	struct simd<float>
+	{
+		static constexpr bool enabled = true;
+		using reg = __m128;
+
+		static reg Load(float const* p) noexcept { return _mm_load_ps(p); }
+		static void Store(float* p, reg r) noexcept { _mm_store_ps(p, r); }
+		static reg Add(reg a, reg b) noexcept { return _mm_add_ps(a, b); }
+		static reg Sub(reg a, reg b) noexcept { return _mm_sub_ps(a, b); }
+		static reg Mul(reg a, reg b) noexcept { return _mm_mul_ps(a, b); }
+		static reg Scale(reg a, float s) noexcept { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+		static reg Div(reg a, float s) noexcept { return _mm_div_ps(a, _mm_set1_ps(s)); }
+		static reg Neg(reg a) noexcept { return _mm_xor_ps(a, _mm_set1_ps(-0.f)); }
+		static float Dot(reg a, reg b) noexcept
+		{
+			auto m = _mm_mul_ps(a, b);
+			auto xy = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+			return _mm_cvtss_f32(_mm_add_ss(xy, _mm_movehl_ps(m, m)));
+		}
+		static reg Cross(reg a, reg b) noexcept
+		{
+			auto yzx = [](reg v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)); };
+			auto zxy = [](reg v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2)); };
+			return _mm_sub_ps(_mm_mul_ps(yzx(a), zxy(b)), _mm_mul_ps(zxy(a), yzx(b)));
+		}
+	};
+
+#ifdef __AVX__
+	template<>
+	struct simd<double>
+	{
+		static constexpr bool enabled = true;
+		using reg = __m256d;
+
+		static reg Load(double const* p) noexcept { return _mm256_loadu_pd(p); }
+		static void Store(double* p, reg r) noexcept { _mm256_storeu_pd(p, r); }
+		static reg Add(reg a, reg b) noexcept { return _mm256_add_pd(a, b); }
+		static reg Sub(reg a, reg b) noexcept { return _mm256_sub_pd(a, b); }
+		static reg Mul(reg a, reg b) noexcept { return _mm256_mul_pd(a, b); }
+		static reg Scale(reg a, double s) noexcept { return _mm256_mul_pd(a, _mm256_set1_pd(s)); }
+		static reg Div(reg a, double s) noexcept { return _mm256_div_pd(a, _mm256_set1_pd(s)); }
+		static reg Neg(reg a) noexcept { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+		static double Dot(reg a, reg b) noexcept
+		{
+			auto m = _mm256_mul_pd(a, b);
+			auto lo = _mm256_castpd256_pd128(m);
+			auto xy = _mm_add_sd(lo, _mm_unpackhi_pd(lo, lo));
+			return _mm_cvtsd_f64(_mm_add_sd(xy, _mm256_extractf128_pd(m, 1)));
+		}
+		static reg Cross(reg a, reg b) noexcept
+		{
+#ifdef __AVX2__
+			auto yzx = [](reg v) { return _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 0, 2, 1)); };
+			auto zxy = [](reg v) { return _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 1, 0, 2)); };
+			return _mm256_sub_pd(_mm256_mul_pd(yzx(a), zxy(b)), _mm256_mul_pd(zxy(a), yzx(b)));
+#else
+			alignas(32) double p[4], q[4];
+			_mm256_store_pd(p, a);
+			_mm256_store_pd(q, b);
+			return _mm256_set_pd(0, p[0] * q[1] - p[1] * q[0], p[2] * q[0] - p[0] * q[2], p[1] * q[2] - p[2] * q[1]);
+#endif
+		}
+	};
+#else
+	// SSE2: X, Y in one register, Z and pad in the other
+	template<>
+	struct simd<double>
+	{
+		static constexpr bool enabled = true;
+		struct reg
+		{
+			__m128d xy, zw;
+		};
+
+		static reg Load(double const* p) noexcept { return {_mm_load_pd(p), _mm_load_pd(p + 2)}; }
+		static void Store(double* p, reg r) noexcept
+		{
+			_mm_store_pd(p, r.xy);
+			_mm_store_pd(p + 2, r.zw);
+		}
+		static reg Add(reg a, reg b) noexcept { return {_mm_add_pd(a.xy, b.xy), _mm_add_pd(a.zw, b.zw)}; }
+		static reg Sub(reg a, reg b) noexcept { return {_mm_sub_pd(a.xy, b.xy), _mm_sub_pd(a.zw, b.zw)}; }
+		static reg Mul(reg a, reg b) noexcept { return {_mm_mul_pd(a.xy, b.xy), _mm_mul_pd(a.zw, b.zw)}; }
+		static reg Scale(reg a, double s) noexcept
+		{
+			auto v = _mm_set1_pd(s);
+			return {_mm_mul_pd(a.xy, v), _mm_mul_pd(a.zw, v)};
+		}
+		static reg Div(reg a, double s) noexcept
+		{
+			auto v = _mm_set1_pd(s);
+			return {_mm_div_pd(a.xy, v), _mm_div_pd(a.zw, v)};
+		}
+		static reg Neg(reg a) noexcept
+		{
+			auto sign = _mm_set1_pd(-0.0);
+			return {_mm_xor_pd(a.xy, sign), _mm_xor_pd(a.zw, sign)};
+		}
+		static double Dot(reg a, reg b) noexcept
+		{
+			auto xy = _mm_mul_pd(a.xy, b.xy);
+			auto s = _mm_add_sd(xy, _mm_unpackhi_pd(xy, xy));
+			return _mm_cvtsd_f64(_mm_add_sd(s, _mm_mul_sd(a.zw, b.zw)));
+		}
+		static reg Cross(reg a, reg b) noexcept
+		{
+			auto zero = _mm_setzero_pd();
+			auto yzx = [&](reg v) { return reg{_mm_shuffle_pd(v.xy, v.zw, 1), _mm_unpacklo_pd(v.xy, zero)}; };
+			auto zxy = [&](reg v) { return reg{_mm_shuffle_pd(v.zw, v.xy, 0), _mm_unpackhi_pd(v.xy, zero)}; };
+			return Sub(Mul(yzx(a), zxy(b)), Mul(zxy(a), yzx(b)));
+		}
+	};
+#endif
+#endif
+} // namespace mth
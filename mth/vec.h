@@ -1,6 +1,7 @@
 #pragma once
 
 #include "mthdef.h"
+#include "simd.h"
 
 namespace mth
 {
@@ -107,10 +108,29 @@ namespace mth
 		}
 	};
 	template<class type>
-	class vec
+	class alignas(simd<type>::enabled ? 16 : alignof(std::remove_reference_t<type>)) vec
 	{
+	private:
+		using lanes = simd<type>;
+		static constexpr bool wide = lanes::enabled;
+		struct none
+		{};
+
+		explicit vec(typename lanes::reg R) noexcept
+			requires wide
+		{
+			lanes::Store(&X, R);
+		}
+		typename lanes::reg Lanes() const noexcept
+			requires wide
+		{
+			return lanes::Load(&X);
+		}
+
 	public:
 		type X, Y, Z;
+		// fourth lane of SIMD types, always zero on construction
+		[[no_unique_address]] std::conditional_t<wide, std::remove_reference_t<type>, none> Pad = {};
 		vec() noexcept {}
 		vec(type A, type B, type C) noexcept
 		: X(A)
@@ -139,6 +159,8 @@ namespace mth
 		template<class type2>
 		vec& operator+=(const vec<type2>& V) noexcept
 		{
+			if constexpr (wide && std::is_same_v<type, type2>)
+				return *this = vec(lanes::Add(Lanes(), V.Lanes()));
 			X += V.X;
 			Y += V.Y;
 			Z += V.Z;
@@ -147,6 +169,8 @@ namespace mth
 		template<class type2>
 		vec& operator-=(const vec<type2>& V) noexcept
 		{
+			if constexpr (wide && std::is_same_v<type, type2>)
+				return *this = vec(lanes::Sub(Lanes(), V.Lanes()));
 			X -= V.X;
 			Y -= V.Y;
 			Z -= V.Z;
@@ -233,9 +257,19 @@ namespace mth
 		vec Max(vec const& V) const noexcept { return vec(std::max(X, V.X), std::max(Y, V.Y), std::max(Z, V.Z)); }
 		bool operator==(vec const& V) const noexcept { return (X == V.X && Y == V.Y && Z == V.Z); }
 		bool operator!=(vec const& V) const noexcept { return !(X == V.X && Y == V.Y && Z == V.Z); }
-		vec operator+(vec const& V) const noexcept { return vec(X + V.X, Y + V.Y, Z + V.Z); }
+		vec operator+(vec const& V) const noexcept
+		{
+			if constexpr (wide)
+				return vec(lanes::Add(Lanes(), V.Lanes()));
+			return vec(X + V.X, Y + V.Y, Z + V.Z);
+		}
 		vec operator+(type N) const noexcept { return vec(X + N, Y + N, Z + N); }
-		vec operator-(vec const& V) const noexcept { return vec(X - V.X, Y - V.Y, Z - V.Z); }
+		vec operator-(vec const& V) const noexcept
+		{
+			if constexpr (wide)
+				return vec(lanes::Sub(Lanes(), V.Lanes()));
+			return vec(X - V.X, Y - V.Y, Z - V.Z);
+		}
 		vec operator/(vec const& V) const noexcept
 		{
 			if (V.X == 0 || V.Y == 0 || V.Z == 0) return vec(X, Y, Z);
@@ -244,6 +278,8 @@ namespace mth
 		template<typename T>
 		vec operator/(T N) const noexcept
 		{
+			if constexpr (wide && std::is_arithmetic_v<T>)
+				return vec(lanes::Div(Lanes(), N));
 			return vec(X / N, Y / N, Z / N);
 		}
 		vec& operator/=(vec const& V) noexcept
@@ -257,15 +293,29 @@ namespace mth
 		vec& operator/=(type N) noexcept
 		{
 			if (N == 0) return *this;
+			if constexpr (wide)
+				return *this = vec(lanes::Div(Lanes(), N));
 			X /= N;
 			Y /= N;
 			Z /= N;
 			return *this;
 		}
-		vec operator*(vec const& N) const noexcept { return vec(X * N.X, Y * N.Y, Z * N.Z); }
-		vec operator*(type N) const noexcept { return vec(X * N, Y * N, Z * N); }
+		vec operator*(vec const& N) const noexcept
+		{
+			if constexpr (wide)
+				return vec(lanes::Mul(Lanes(), N.Lanes()));
+			return vec(X * N.X, Y * N.Y, Z * N.Z);
+		}
+		vec operator*(type N) const noexcept
+		{
+			if constexpr (wide)
+				return vec(lanes::Scale(Lanes(), N));
+			return vec(X * N, Y * N, Z * N);
+		}
 		vec& operator*=(vec const& V) noexcept
 		{
+			if constexpr (wide)
+				return *this = vec(lanes::Mul(Lanes(), V.Lanes()));
 			X *= V.X;
 			Y *= V.Y;
 			Z *= V.Z;
@@ -273,21 +323,32 @@ namespace mth
 		}
 		vec& operator*=(type N) noexcept
 		{
+			if constexpr (wide)
+				return *this = vec(lanes::Scale(Lanes(), N));
 			X *= N;
 			Y *= N;
 			Z *= N;
 			return *this;
 		}
-		vec operator-() const noexcept { return vec(-X, -Y, -Z); }
-		type operator&(vec const& V) const noexcept { return X * V.X + Y * V.Y + Z * V.Z; }
-		vec operator%(vec const& V) const noexcept { return vec(Y * V.Z - Z * V.Y, Z * V.X - X * V.Z, X * V.Y - Y * V.X); }
-		vec operator%=(vec const& V) noexcept
+		vec operator-() const noexcept
 		{
-			X = Y * V.Z - V.Y * Z;
-			Y = V.X * Z - X * V.Z;
-			Z = X * V.Y - V.X * Y;
-			return *this;
+			if constexpr (wide)
+				return vec(lanes::Neg(Lanes()));
+			return vec(-X, -Y, -Z);
+		}
+		type operator&(vec const& V) const noexcept
+		{
+			if constexpr (wide)
+				return lanes::Dot(Lanes(), V.Lanes());
+			return X * V.X + Y * V.Y + Z * V.Z;
 		}
+		vec operator%(vec const& V) const noexcept
+		{
+			if constexpr (wide)
+				return vec(lanes::Cross(Lanes(), V.Lanes()));
+			return vec(Y * V.Z - Z * V.Y, Z * V.X - X * V.Z, X * V.Y - Y * V.X);
+		}
+		vec operator%=(vec const& V) noexcept { return *this = *this % V; }
 		vec Normalizing() const noexcept
 		{
 			type len = *this & *this;
@@ -304,8 +365,8 @@ namespace mth
 			Z /= len;
 			return *this;
 		}
-		float Len() const noexcept { return sqrt(X * X + Y * Y + Z * Z); }
-		float Len2() const noexcept { return X * X + Y * Y + Z * Z; }
+		type Len() const noexcept { return sqrt(Len2()); }
+		type Len2() const noexcept { return *this & *this; }
 		type& operator[](int I) noexcept
 		{
 			assert(I >= 0 && I < 3);
@@ -443,6 +504,8 @@ namespace mth
 	template<typename T, typename Y>
 	vec<T> operator*(Y const& y, vec<T> const& v)
 	{
+		if constexpr (simd<T>::enabled && std::is_arithmetic_v<Y>)
+			return v * T(y);
 		return {v.X * y, v.Y * y, v.Z * y};
 	}
 	template<typename T, typename Y>
@@ -451,6 +514,12 @@ namespace mth
 		return {v.X * y, v.Y * y, v.Z * y, v.W * y};
 	}
 
+	template<typename T>
+	bool IsFinite(vec<T> const& v) noexcept
+	{
+		return IsFinite(v.X) && IsFinite(v.Y) && IsFinite(v.Z);
+	}
+
 	template<typename T, typename Y, typename F>
 	inline void Zip(T& v1, T& v2, F const& f)
 	{
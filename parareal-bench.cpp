@@ -0,0 +1,41 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "Parareal.h"
+
+/*
+ * Parareal against the serial fine reference.
+ * usage: parareal-bench [duration = 60] [slices = 4 * threads] [fine step = 1e-4] [coarse step = 1e-2] [tolerance = 1e-6]
+ */
+int main(int argc, char* argv[])
+{
+	auto threads = std::max(1u, std::thread::hardware_concurrency());
+	double duration = argc > 1 ? std::atof(argv[1]) : 60;
+	std::size_t slices = argc > 2 ? std::atoi(argv[2]) : 4 * threads;
+	double fineStep = argc > 3 ? std::atof(argv[3]) : 1e-4;
+	double coarseStep = argc > 4 ? std::atof(argv[4]) : 1e-2;
+	double tolerance = argc > 5 ? std::atof(argv[5]) : 1e-6;
+
+	Pendulum pend;
+	pend.AddBall({0.5, 0.3, 50}, {0.1, 0, -0.5});
+	pend.AddBall({0.2, 0.4, 25});
+
+	auto serial = pend;
+	auto start = std::chrono::steady_clock::now();
+	Parareal<>::Propagate(serial, duration, fineStep, RungeKuttaSolver());
+	auto serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Parareal<> para(slices, coarseStep, fineStep);
+	para.tolerance = tolerance;
+	auto parallel = pend;
+	auto rep = para.Run(parallel, duration);
+
+	double error = 0;
+	for (std::size_t i = 0; i < pend.ballCoords.size(); i += 2)
+		error = std::max<double>(error, (serial.ballCoords[i] - parallel.ballCoords[i]).Len());
+	std::cout
+		<< threads << " threads, " << slices << " slices, " << rep.iterations << " iterations\n"
+		<< "serial " << serialSeconds << " s, parareal " << rep.seconds << " s, speedup " << serialSeconds / rep.seconds << "\n"
+		<< "max position error " << error << ", last defect " << rep.defect << std::endl;
+}
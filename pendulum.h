@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Audit.h"
 #include "Solvers.h"
 
 #include <chrono>
@@ -10,23 +11,35 @@
 
 using vec = mth::vec<double>;
 
-class Pendulum
+// T is double everywhere except differentiation, see Fit.h
+template<typename T = double>
+class BasicPendulum
 {
 private:
 	std::chrono::time_point<std::chrono::system_clock> prev = std::chrono::system_clock::now();
+	// scratch of in-place solvers, not copied with the pendulum
+	SolverWork<std::valarray<mth::vec<T>>> work;
 public:
+	using scalar = T;
+	using vec = mth::vec<T>;
+
 	struct BallData
 	{
-		double
+		T
 			r = 5,
 			m = 3,
 			k = 10;
+		// link above is an inextensible rod of length r, honoured by RattleStepper,
+		// other solvers treat it as a spring
+		bool rod = false;
 	};
 	std::vector<BallData> ballParams;
 	std::valarray<vec> ballCoords; // as {{x, v}, ...}
 
-	Pendulum& PopBall() noexcept
+	BasicPendulum& PopBall() noexcept
 	{
+		AUDIT_SCOPE("Pendulum::PopBall");
+		AUDIT_COPY((ballCoords.size() - 2) * sizeof(vec));
 		ballParams.pop_back();
 		auto nv = std::valarray<vec>(ballCoords.size() - 2);
 		for (std::size_t i = 0; i < ballCoords.size() - 2; i++)
@@ -35,7 +48,7 @@ public:
 		return *this;
 	}
 
-	Pendulum& AddBall(BallData const& bd, vec x0 = {0, 0, -1e40}, vec v0 = {0, 0, 0})
+	BasicPendulum& AddBall(BallData const& bd, vec x0 = {0, 0, -1e40}, vec v0 = {0, 0, 0})
 	{
 		// I wanted to use nan but fast-math kills everything
 		if (x0.Z == -1e40)
@@ -43,6 +56,8 @@ public:
 				x0.Z = -bd.r;
 			else
 				x0 = ballCoords[ballCoords.size() - 2] + vec(0, 0, -bd.r);
+		AUDIT_SCOPE("Pendulum::AddBall");
+		AUDIT_COPY(ballCoords.size() * sizeof(vec));
 		ballParams.emplace_back(bd);
 		auto nv = std::valarray<vec>(ballCoords.size() + 2);
 		for (std::size_t i = 0; i < ballCoords.size(); i++)
@@ -55,13 +70,36 @@ public:
 
 	vec g = {0, 0, -9.8};
 
+	// spring above ball i: rest length is r of ball i, stiffness is k of the ball above it
+	// (the first spring uses k of the first ball, so k of the last ball is unused)
+	T LinkLength(std::size_t i) const noexcept { return ballParams[i].r; }
+	T LinkStiffness(std::size_t i) const noexcept { return ballParams[i == 0 ? 0 : i - 1].k; }
+	// spring force on the lower end of link i stretched to d (from upper end to lower one)
+	vec LinkForce(std::size_t i, vec const& d) const noexcept { return d * ((LinkLength(i) / d.Len() - 1) * LinkStiffness(i)); }
+
+	// kinetic + spring + gravity energy of state p (as ballCoords), zero height at the pivot
+	T Energy(std::valarray<vec> const& p) const noexcept
+	{
+		T e = 0;
+		for (std::size_t i = 0; i < ballParams.size(); i++)
+		{
+			auto const& x = p[i * 2];
+			auto const& v = p[i * 2 + 1];
+			auto stretch = (i == 0 ? x : x - p[i * 2 - 2]).Len() - LinkLength(i);
+			e += ballParams[i].m * ((v & v) / 2 - (g & x)) + LinkStiffness(i) * stretch * stretch / 2;
+		}
+		return e;
+	}
+
+	// sphere of ball i, for drawing and collisions
+	T Radius(std::size_t i) const noexcept { return std::cbrt(ballParams[i].m) / 10; }
+
 	bool frozen = false;
 
 	template<typename S = RungeKuttaSolver>
 	void Update(std::chrono::time_point<std::chrono::system_clock> const& now, S const& solver = S())
 	{
 		using namespace mth;
-		using vec = ::vec;
 		// auto now = std::chrono::system_clock::now();
 		if (frozen)
 		{
@@ -77,42 +115,96 @@ public:
 
 		prev = std::move(now);
 
+		Step(delta, solver);
+	}
+
+	// advances by exactly delta: same state and delta always give the same result
+	template<typename S = RungeKuttaSolver>
+	void Step(double delta, S const& solver = S())
+	{
+		Step(delta, solver, nullptr);
+	}
+
+	// same with extra accelerations: accel(dt) is called once per stage at offset dt and
+	// returns a(i, x, v, m) for ball i, added inside Derivative's loop (see Forces.h); nullptr for none
+	template<typename S, typename A>
+	void Step(double delta, S const& solver, A const& accel)
+	{
 		if (ballParams.empty())
 			return;
 		assert(ballParams.size() * 2 == ballCoords.size());
+		AUDIT_SCOPE("Pendulum::Step");
 
-		// f > 0 <=> spring got longer => force is directed to collapse
-		auto deltacalc = [&](auto const& p, double delta) {
+		auto fill = [this, &accel](auto const& p, double delta, auto& out) { Derivative(p, delta, out, accel); };
+		if constexpr (requires { solver.InPlace(fill, ballCoords, delta, work); })
+		{
+			solver.InPlace(fill, ballCoords, delta, work);
+			return;
+		}
+		auto res = solver(
+				[this, &accel](auto const& p, double delta) {
 					auto ret = std::valarray<vec>(p.size());
-					auto fp = (1 - ballParams[0].r / ballCoords[0].Len()) * ballParams[0].k;
-					vec xp= vec(0);
-					for (std::size_t i = 0; i < ballParams.size() - 1; i++)
-					{
-						auto const& par = ballParams[i];
-						auto const& parn = ballParams[i + 1];
-						auto const& xm = p[i * 2];
-						auto const& vm = p[i * 2 + 1];
-						auto const& xn = p[i * 2 + 2];
-						// x' = v
-						ret[i * 2] = vm * delta;
-						auto fn = (1 - parn.r / (xn - xm).Len()) * par.k;
-						// v' = a
-						ret[i * 2 + 1] = fp / par.m * (xp - xm) + (xn - xm) * fn / par.m + g;
-						fp = fn;
-						xp = xm;
-					}
-					// x'
-					ret[ret.size() - 2] = p[p.size() - 1] * delta;
-					// v'
-					ret[ret.size() - 1] = fp * (xp - p[p.size() - 2]) / ballParams.back().m + g;
+					Derivative(p, delta, ret, accel);
 					return ret;
-				};
-		auto res = solver(
-				deltacalc,
+				},
 				ballCoords,
 				delta
 			);
 		ballCoords += res;
 	}
+
+	// f > 0 <=> spring got longer => force is directed to collapse
+	std::valarray<vec> Derivative(std::valarray<vec> const& p, double delta) const
+	{
+		auto ret = std::valarray<vec>(p.size());
+		Derivative(p, delta, ret);
+		return ret;
+	}
+
+	// same into ret of p's size, does not allocate
+	void Derivative(std::valarray<vec> const& p, double delta, std::valarray<vec>& ret) const
+	{
+		Derivative(p, delta, ret, nullptr);
+	}
+
+	// with extra accelerations, as Step
+	template<typename A>
+	void Derivative(std::valarray<vec> const& p, double delta, std::valarray<vec>& ret, A const& accel) const
+	{
+		using namespace mth;
+		constexpr bool extra = !std::is_null_pointer_v<A>;
+		[[maybe_unused]] auto stage = [&] {
+			if constexpr (extra)
+				return accel(delta);
+			else
+				return nullptr;
+		}();
+		auto fp = (1 - ballParams[0].r / p[0].Len()) * ballParams[0].k;
+		vec xp= vec(0);
+		for (std::size_t i = 0; i < ballParams.size() - 1; i++)
+		{
+			auto const& par = ballParams[i];
+			auto const& parn = ballParams[i + 1];
+			auto const& xm = p[i * 2];
+			auto const& vm = p[i * 2 + 1];
+			auto const& xn = p[i * 2 + 2];
+			// x' = v
+			ret[i * 2] = vm;
+			auto fn = (1 - parn.r / (xn - xm).Len()) * par.k;
+			// v' = a
+			ret[i * 2 + 1] = fp / par.m * (xp - xm) + (xn - xm) * fn / par.m + g;
+			if constexpr (extra)
+				ret[i * 2 + 1] += stage(i, xm, vm, par.m);
+			fp = fn;
+			xp = xm;
+		}
+		// x'
+		ret[ret.size() - 2] = p[p.size() - 1];
+		// v'
+		ret[ret.size() - 1] = fp * (xp - p[p.size() - 2]) / ballParams.back().m + g;
+		if constexpr (extra)
+			ret[ret.size() - 1] += stage(ballParams.size() - 1, p[p.size() - 2], p[p.size() - 1], ballParams.back().m);
+	}
 };
 
+using Pendulum = BasicPendulum<>;
@@ -0,0 +1,105 @@
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "Scenario.h"
+
+/*
+ * Malformed scenarios must not load: binary files with non-finite or non-positive
+ * values patched in, and text files with bad ball parameters. The project builds
+ * with -ffast-math, so this also checks that Validate still sees NaN and infinity.
+ */
+namespace
+{
+	std::string const path = "scenario-test.bin";
+	int failures = 0;
+
+	scenario::Scenario Valid()
+	{
+		scenario::Scenario s;
+		s.pend.AddBall({0.5, 0.3, 50}, {0.3, 0, -0.4});
+		s.pend.AddBall({0.5, 0.3, 50});
+		return s;
+	}
+
+	void Expect(char const* name, bool loads, std::function<void(std::fstream&)> const& patch)
+	{
+		{
+			std::ofstream out(path, std::ios::binary);
+			scenario::SaveBinary(out, Valid());
+		}
+		{
+			std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+			patch(f);
+		}
+		bool loaded = true;
+		try
+		{
+			scenario::Load(path);
+		}
+		catch (std::exception const&)
+		{
+			loaded = false;
+		}
+		if (loaded != loads)
+		{
+			std::cout << name << ": " << (loaded ? "loaded" : "rejected") << std::endl;
+			failures++;
+		}
+	}
+
+	void Write(std::fstream& f, std::size_t at, double v)
+	{
+		f.seekp(at);
+		f.write(reinterpret_cast<char const*>(&v), sizeof(v));
+	}
+
+	void ExpectText(char const* name, std::string const& text)
+	{
+		{
+			std::ofstream out(path);
+			out << text;
+		}
+		try
+		{
+			scenario::Load(path);
+			std::cout << name << ": loaded" << std::endl;
+			failures++;
+		}
+		catch (std::exception const&)
+		{
+		}
+	}
+} // namespace
+
+int main()
+{
+	using scenario::Ball;
+	using scenario::Header;
+	auto nan = std::numeric_limits<double>::quiet_NaN();
+	auto inf = std::numeric_limits<double>::infinity();
+	auto ball = [](std::size_t i) { return sizeof(Header) + i * sizeof(Ball); };
+	auto state = [](std::size_t i) { return sizeof(Header) + 2 * sizeof(Ball) + i * 3 * sizeof(double); };
+
+	Expect("unchanged", true, [](std::fstream&) {});
+	Expect("NaN mass", false, [&](std::fstream& f) { Write(f, ball(1) + offsetof(Ball, m), nan); });
+	Expect("zero mass", false, [&](std::fstream& f) { Write(f, ball(0) + offsetof(Ball, m), 0); });
+	Expect("infinite stiffness", false, [&](std::fstream& f) { Write(f, ball(0) + offsetof(Ball, k), inf); });
+	Expect("NaN length", false, [&](std::fstream& f) { Write(f, ball(1) + offsetof(Ball, r), nan); });
+	Expect("infinite position", false, [&](std::fstream& f) { Write(f, state(0), inf); });
+	Expect("NaN velocity", false, [&](std::fstream& f) { Write(f, state(3) + sizeof(double), nan); });
+	Expect("NaN gravity", false, [&](std::fstream& f) { Write(f, offsetof(Header, g) + sizeof(double), nan); });
+	Expect("NaN step", false, [&](std::fstream& f) { Write(f, offsetof(Header, step), nan); });
+
+	ExpectText("zero mass", "ball 0.5 50 0\n");
+	ExpectText("negative length", "ball -1 50 0.3\n");
+	ExpectText("negative step", "step -0.01\nball 0.5 50 0.3\n");
+
+	std::remove(path.c_str());
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "Scenario.h"
+
+/*
+ * Scenario files, see Scenario.h.
+ * usage:
+ *   scenario-tool convert in out [--binary]  -- rewrite in either form
+ *   scenario-tool chain balls out [--binary] -- hanging chain of equal balls
+ *   scenario-tool info file                  -- load, validate and time it
+ */
+int main(int argc, char* argv[])
+{
+	std::string cmd = argc > 1 ? argv[1] : "";
+	bool binary = argc > 4 && std::string(argv[4]) == "--binary";
+	// ball count of chain, 0 if not a positive number
+	std::size_t n = 0;
+	if (cmd == "chain" && argc > 3)
+	{
+		char* end = nullptr;
+		auto count = std::strtoll(argv[2], &end, 10);
+		if (end != argv[2] && *end == '\0' && count > 0)
+			n = static_cast<std::size_t>(count);
+	}
+	try
+	{
+		if (cmd == "convert" && argc > 3)
+			scenario::Save(argv[3], scenario::Load(argv[2]), binary);
+		else if (n > 0)
+		{
+			scenario::Scenario s;
+			// filled directly, AddBall would copy the state n times
+			s.pend.ballParams.assign(n, {0.01, 0.001, 50000});
+			s.pend.ballCoords.resize(n * 2);
+			for (std::size_t i = 0; i < n; i++)
+			{
+				s.pend.ballCoords[i * 2] = vec(0, 0, -0.01 * (i + 1));
+				s.pend.ballCoords[i * 2 + 1] = vec(0);
+			}
+			s.pend.ballCoords[n * 2 - 1] = vec(0.1, 0, 0);
+			scenario::Save(argv[3], s, binary);
+		}
+		else if (cmd == "info" && argc > 2)
+		{
+			auto start = std::chrono::steady_clock::now();
+			auto s = scenario::Load(argv[2]);
+			auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout
+				<< (scenario::IsBinary(argv[2]) ? "binary" : "text") << ", " << s.pend.ballParams.size() << " balls, "
+				<< Name(s.solver) << " step " << s.step << ", g " << s.pend.g.X << ' ' << s.pend.g.Y << ' ' << s.pend.g.Z << '\n'
+				<< "loaded in " << seconds * 1e3 << " ms" << std::endl;
+		}
+		else
+		{
+			std::cerr << "usage: scenario-tool convert in out [--binary] | chain balls out [--binary] | info file" << std::endl;
+			return 2;
+		}
+	}
+	catch (std::exception const& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
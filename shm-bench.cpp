@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "SharedState.h"
+
+/*
+ * Shared state latency/throughput benchmark.
+ * usage: shm-bench [balls = 64] [frames = 1000000] [rate in Hz, 0 = unlimited]
+ * A forked reader process follows the publisher and reports
+ * publication-to-read latency and how many frames it got lapped on.
+ */
+namespace
+{
+	std::int64_t NowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	int RunReader(std::string const& name, std::uint64_t frames, int ready)
+	{
+		shm::Reader reader(name);
+		char c = 1;
+		if (write(ready, &c, 1) != 1)
+			return 1;
+		close(ready);
+
+		std::vector<std::int64_t> latency;
+		latency.reserve(std::min<std::uint64_t>(frames, 1 << 24));
+		std::uint64_t next = 0, lost = 0;
+		double checksum = 0;
+		auto start = NowNs();
+		while (next < frames)
+		{
+			auto published = reader.Published();
+			if (published <= next)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			// read only the newest frame, count everything skipped as lost
+			auto last = published - 1;
+			lost += last - next;
+			bool ok = reader.Visit(last, [&](shm::Frame const& fr) {
+						auto now = NowNs();
+						double sum = 0;
+						for (std::uint32_t i = 0; i < fr.balls * 6; i++)
+							sum += fr.data[i];
+						checksum += sum;
+						if (latency.size() < latency.capacity())
+							latency.push_back(now - fr.stamp);
+					});
+			if (!ok)
+				lost++;
+			next = last + 1;
+		}
+		auto elapsed = (NowNs() - start) * 1e-9;
+
+		std::sort(latency.begin(), latency.end());
+		auto pct = [&](double p) {
+					return latency.empty() ? 0 : latency[std::min(latency.size() - 1, std::size_t(p * latency.size()))];
+				};
+		std::cout
+			<< "reader: " << frames - lost << " frames read, " << lost << " lost, "
+			<< (frames - lost) / elapsed << " frames/s\n"
+			<< "latency ns: p50 " << pct(0.5) << ", p99 " << pct(0.99) << ", p99.9 " << pct(0.999)
+			<< ", max " << (latency.empty() ? 0 : latency.back()) << "\n"
+			<< "(checksum " << checksum << ")" << std::endl;
+		return 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::uint32_t balls = argc > 1 ? std::atoi(argv[1]) : 64;
+	std::uint64_t frames = argc > 2 ? std::atoll(argv[2]) : 1000000;
+	double rate = argc > 3 ? std::atof(argv[3]) : 0;
+	std::string name = "/pendulum-bench-" + std::to_string(getpid());
+
+	Pendulum pend;
+	for (std::uint32_t i = 0; i < balls; i++)
+		pend.AddBall({0.1, 0.1, 50});
+
+	shm::Publisher pub(name, balls);
+
+	int ready[2];
+	if (pipe(ready) != 0)
+		return 1;
+	auto pid = fork();
+	if (pid < 0)
+		return 1;
+	if (pid == 0)
+	{
+		close(ready[0]);
+		_exit(RunReader(name, frames, ready[1]));
+	}
+	close(ready[1]);
+	char c;
+	if (read(ready[0], &c, 1) != 1)
+		return 1;
+	close(ready[0]);
+
+	auto period = std::chrono::nanoseconds(rate > 0 ? static_cast<std::int64_t>(1e9 / rate) : 0);
+	auto begin = std::chrono::steady_clock::now();
+	auto start = NowNs();
+	for (std::uint64_t f = 0; f < frames; f++)
+	{
+		// sleep rather than spin, the reader may share our core
+		if (period.count() != 0)
+			std::this_thread::sleep_until(begin + f * period);
+		pend.ballCoords[0].X = f;
+		pub.Publish(pend, f);
+	}
+	auto elapsed = (NowNs() - start) * 1e-9;
+	std::cout
+		<< "writer: " << frames / elapsed << " frames/s, "
+		<< frames * balls * 6 * sizeof(double) / elapsed / (1 << 20) << " MiB/s" << std::endl;
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
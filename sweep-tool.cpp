@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "Sweep.h"
+
+/*
+ * Parameter sweeps across local worker processes, see Sweep.h.
+ * usage:
+ *   sweep-tool run spec [--workers N = cores] [--out file.csv = stdout] [--socket path]
+ *   sweep-tool worker path  -- join a running coordinator
+ * Rows are written as points finish: index, swept values, ok, energy at start and end,
+ * relative energy drift and the last ball position.
+ */
+int main(int argc, char* argv[])
+{
+	std::string cmd = argc > 1 ? argv[1] : "";
+	try
+	{
+		if (cmd == "worker" && argc > 2)
+			return sweep::Worker(argv[2]);
+		if (cmd != "run" || argc < 3)
+		{
+			std::cerr << "usage: sweep-tool run spec [--workers N] [--out file] [--socket path] | worker path" << std::endl;
+			return 2;
+		}
+		unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+		std::string out, path = "/tmp/pendulum-sweep-" + std::to_string(getpid()) + ".sock";
+		for (int i = 3; i + 1 < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--workers")
+				workers = std::atoi(argv[++i]);
+			else if (arg == "--out")
+				out = argv[++i];
+			else if (arg == "--socket")
+				path = argv[++i];
+			else
+				throw std::runtime_error("unknown option " + arg);
+		}
+		auto spec = sweep::LoadSpec(argv[2]);
+		auto file = out.empty() ? stdout : std::fopen(out.c_str(), "w");
+		if (!file)
+			throw std::runtime_error("cannot write " + out);
+
+		std::fprintf(file, "index");
+		for (auto const& a : spec.axes)
+			std::fprintf(file, ",%s", a.Name().c_str());
+		std::fprintf(file, ",ok,energy0,energy,drift,x,y,z\n");
+		sweep::Coordinator coord(spec, path, workers);
+		auto rep = coord.Run([&](sweep::Outcome const& o) {
+			std::fprintf(file, "%llu", static_cast<unsigned long long>(o.index));
+			for (auto v : spec.Values(o.index))
+				std::fprintf(file, ",%.17g", v);
+			auto drift = o.energy0 != 0 ? (o.energy - o.energy0) / std::abs(o.energy0) : 0;
+			std::fprintf(file, ",%u,%.17g,%.17g,%.6g,%.17g,%.17g,%.17g\n", o.ok, o.energy0, o.energy, drift, o.x[0], o.x[1], o.x[2]);
+		});
+		if (file != stdout)
+			std::fclose(file);
+		else
+			std::fflush(file);
+
+		std::cerr
+			<< rep.points << " points in " << rep.shards << " shards on " << workers << " workers, " << rep.seconds << " s\n"
+			<< rep.ok << " ok, " << rep.failed << " failed, " << rep.crashes << " workers lost, " << rep.retried << " shards retried" << std::endl;
+		return rep.failed ? 1 : 0;
+	}
+	catch (std::exception const& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}